@@ -6,8 +6,15 @@
 #pragma once
 
 
+#include <algorithm>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
+#include <AdvancedRlp/AdvancedRlp.hpp>
 #include <DecentEnclave/Common/Logging.hpp>
 #include <EclipseMonitor/Eth/DiffChecker.hpp>
 #include <EclipseMonitor/Eth/EclipseMonitor.hpp>
@@ -15,10 +22,17 @@
 #include <EclipseMonitor/Eth/Validator.hpp>
 #include <SimpleObjects/Codec/Hex.hpp>
 #include <SimpleObjects/Internal/make_unique.hpp>
+#include <SimpleRlp/SimpleRlp.hpp>
 
+#include "EnclaveWorkerPool.hpp"
+#include "EventDispatcher.hpp"
 #include "HostBlockService.hpp"
+#include "LatestBlkNumCache.hpp"
 #include "Pubsub/SubscriberService.hpp"
 #include "RandomGenerator.hpp"
+#include "ReceiptJobQueue.hpp"
+#include "ReceiptListenerGroups.hpp"
+#include "SubscriptionLifecycle.hpp"
 #include "Timestamper.hpp"
 
 
@@ -28,8 +42,34 @@ namespace Trusted
 {
 
 
+/**
+ * @brief The part of BlockchainMgr that doesn't depend on the network
+ *        configuration, so managers of different networks can be kept in
+ *        the same container
+ *
+ */
+class BlockchainMgrBase
+{
+public:
+
+	BlockchainMgrBase() = default;
+
+	// LCOV_EXCL_START
+	virtual ~BlockchainMgrBase() = default;
+	// LCOV_EXCL_STOP
+
+	virtual const std::string& GetChainName() const = 0;
+
+	virtual void AppendBlock(const std::vector<uint8_t>& headerRlp) = 0;
+
+	virtual std::vector<uint8_t> BuildCheckpoint() = 0;
+
+}; // class BlockchainMgrBase
+
+
 template<typename _NetConfig>
-class BlockchainMgr
+class BlockchainMgr :
+	public BlockchainMgrBase
 {
 public: // static members:
 
@@ -47,6 +87,129 @@ public: // static members:
 
 	using EclipseMonitorType = EclipseMonitor::Eth::EclipseMonitor;
 
+	static constexpr size_t sk_pendingJobsPerWorker = 2;
+
+
+	/**
+	 * @brief An immutable snapshot of the monitor state, which is published
+	 *        after each block, so readers (e.g., the heartbeat emitters)
+	 *        never have to lock the monitor;
+	 *        all fields are published together, and belong to the block
+	 *        m_lastValidatedBlkNum, i.e., the last block whose events have
+	 *        been dispatched, even though the monitor may have validated
+	 *        a few more blocks by then
+	 *
+	 */
+	struct MonitorSnapshot
+	{
+		EclipseMonitor::MonitorSecState m_secState;
+		// the secure state encoded in Advanced RLP; it's encoded once
+		// when the state is published and shared by all subscribers
+		std::shared_ptr<const SimpleObjects::Bytes> m_secStateRlp;
+		EclipseMonitor::Phases          m_phase;
+		SimpleObjects::Bytes            m_lastValidatedBlkNum;
+		SimpleObjects::Bytes            m_lastValidatedBlkHash;
+	}; // struct MonitorSnapshot
+
+	using MonitorSnapshotPtr = std::shared_ptr<const MonitorSnapshot>;
+
+
+	/**
+	 * @brief The state of the monitor right after a block is validated,
+	 *        kept until the events of that block are dispatched
+	 *
+	 */
+	struct StagedMonitorState
+	{
+		uint64_t                                    m_blkNum;
+		EclipseMonitor::MonitorSecState             m_secState;
+		std::shared_ptr<const SimpleObjects::Bytes> m_secStateRlp;
+		EclipseMonitor::Phases                      m_phase;
+	}; // struct StagedMonitorState
+
+
+	/**
+	 * @brief Where a chain restored from a checkpoint resumes
+	 *
+	 */
+	struct ResumePoint
+	{
+		ResumePoint() :
+			m_blkNum(0),
+			m_parentHash()
+		{}
+
+		// the number of the block to start from
+		uint64_t             m_blkNum;
+		// the hash of the block the checkpoint was taken at, which must be
+		// the parent of the block to start from
+		SimpleObjects::Bytes m_parentHash;
+	}; // struct ResumePoint
+
+
+	/**
+	 * @brief Restore the state saved in the given checkpoint (see
+	 *        BuildCheckpoint) into the subscriber service
+	 *        NOTE: the Eclipse Monitor doesn't support restoring its
+	 *        internal state (the secure state and the checkpoint window),
+	 *        so only the pub-sub state is restored, and the monitor is
+	 *        bootstrapped again starting from the block right after the
+	 *        checkpoint; what the saved secure state still vouches for is
+	 *        the block the checkpoint was taken at, so the resumed chain
+	 *        has to extend that block (see ExpectResumeFrom)
+	 *
+	 * @param chkptAdvRlp The checkpoint encoded in Advanced RLP
+	 * @param subSvc      The subscriber service that hasn't been started yet
+	 */
+	static ResumePoint RestoreCheckpoint(
+		const std::vector<uint8_t>& chkptAdvRlp,
+		Pubsub::SubscriberService& subSvc
+	)
+	{
+		static const SimpleObjects::String sk_labelSecState("SecState");
+		static const SimpleObjects::String sk_labelBlkNum("BlkNum");
+		static const SimpleObjects::String sk_labelPubSub("PubSub");
+		static const SimpleObjects::String sk_labelBlkHash("BlkHash");
+
+		auto chkpt = AdvancedRlp::Parse(chkptAdvRlp);
+		const auto& chkptDict = chkpt.AsDict();
+
+		const auto& blkNumBytes = chkptDict[sk_labelBlkNum].AsBytes();
+		if (blkNumBytes.size() > sizeof(uint64_t))
+		{
+			throw std::runtime_error("Invalid block number in checkpoint");
+		}
+		uint64_t blkNum = 0;
+		for (const auto& b : blkNumBytes)
+		{
+			blkNum = (blkNum << 8) | b;
+		}
+
+		ResumePoint resumePoint;
+		resumePoint.m_blkNum = blkNum + 1;
+		// checkpoints taken before the block hash was saved can't be
+		// checked against the resumed chain
+		if (chkptDict.HasKey(sk_labelBlkHash))
+		{
+			resumePoint.m_parentHash = chkptDict[sk_labelBlkHash].AsBytes();
+		}
+
+		subSvc.RestoreCheckpoint(chkptDict[sk_labelPubSub].AsDict());
+
+		const auto& secStateRlp = chkptDict[sk_labelSecState].AsBytes();
+		DecentEnclave::Common::LoggerFactory::GetLogger("BlockchainMgr").Info(
+			"Resuming from the checkpoint at block #" +
+			std::to_string(blkNum) + " (" +
+			SimpleObjects::Codec::Hex::Encode<std::string>(
+				resumePoint.m_parentHash
+			) +
+			"); the previous secure state was " +
+			SimpleObjects::Codec::Hex::Encode<std::string>(secStateRlp)
+		);
+
+		return resumePoint;
+	}
+
 
 	static std::unique_ptr<ValidatorType> MakeValidator()
 	{
@@ -69,6 +232,7 @@ public: // static members:
 public:
 
 	BlockchainMgr(
+		const std::string& chainName,
 		const EclipseMonitor::MonitorConfig& mConfig,
 		uint64_t startBlockNum,
 		const EclipseMonitor::Eth::ContractAddr& syncContractAddr,
@@ -76,8 +240,12 @@ public:
 		std::unique_ptr<Pubsub::SubscriberService> subSvc,
 		std::unique_ptr<HostBlockService> hostBlkSvc
 	) :
+		BlockchainMgrBase(),
+		m_chainName(chainName),
 		m_logger(
-			DecentEnclave::Common::LoggerFactory::GetLogger("BlockchainMgr")
+			DecentEnclave::Common::LoggerFactory::GetLogger(
+				"BlockchainMgr(" + chainName + ")"
+			)
 		),
 		m_monitorConfig(mConfig),
 		m_monitorMutex(),
@@ -98,25 +266,147 @@ public:
 				EclipseMonitor::Eth::Keccak256(syncEventSign)
 			)
 		),
+		m_eventDispatcher(
+			std::make_shared<EventDispatcher>(m_monitor->GetEventManager())
+		),
 		m_lastChkptIter(0),
+		m_resumePoint(),
 		m_subSvc(std::move(subSvc)),
 		m_hostBlkSvc(std::move(hostBlkSvc)),
-		m_lastValidatedBlkNum()
+		m_latestBlkNumCache(*m_hostBlkSvc),
+		m_snapshotMutex(),
+		m_snapshot(),
+		m_stagedStates(),
+		m_lastSubmittedBlkNum(0),
+		m_commitMutex(),
+		m_receiptJobs(
+			[this](EclipseMonitor::Eth::BlockNumber blkNum)
+				-> SimpleObjects::Object
+			{
+				return m_hostBlkSvc->GetReceiptsRlpByNum(blkNum);
+			},
+			true
+		),
+		m_pubsubSubCounter(std::make_shared<SubscriptionCounter>()),
+		m_receiptSubCounter(std::make_shared<SubscriptionCounter>()),
+		m_receiptGroups(
+			std::make_shared<ReceiptListenerGroups>(m_eventDispatcher)
+		)
 	{
-		const auto latestBlkNum = m_hostBlkSvc->GetLatestBlockNum();
+		// The sync event is listened by the monitor itself, so we have to
+		// let the filter stage know about it
+		m_eventDispatcher->AddMonitorEvent(
+			syncContractAddr,
+			std::vector<EclipseMonitor::Eth::EventTopic>({
+				EclipseMonitor::Eth::Keccak256(syncEventSign),
+			})
+		);
+
+		const auto latestBlkNum = m_latestBlkNumCache.Refresh();
 		m_monitor->RefreshBootstrapPlan(latestBlkNum, &startBlockNum);
+		PublishMonitorState();
 
-		m_subSvc->Start(m_monitor->GetEventManager());
+		m_subSvc->Start(m_eventDispatcher);
 	}
 
 
-	~BlockchainMgr() = default;
+	virtual ~BlockchainMgr() = default;
 
 
-	void AppendBlock(const std::vector<uint8_t>& headerRlp)
+	virtual const std::string& GetChainName() const override
+	{
+		return m_chainName;
+	}
+
+
+	virtual void AppendBlock(const std::vector<uint8_t>& headerRlp) override
+	{
+		// Stage 0 - if the receipts of an earlier block couldn't be
+		// processed, retry them first; if they still fail, the header is
+		// refused (so the host will give it again later), rather than
+		// letting the later blocks be committed without those events
+		if (m_receiptJobs.HasFailedJob())
+		{
+			std::lock_guard<std::mutex> lock(m_commitMutex);
+			CommitReceiptJobs(0);
+		}
+
+		// Stage 1 - validate the header;
+		// only this stage needs the monitor to be locked
+		size_t maxPendingJobs = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_monitorMutex);
+			const bool isResumeHeader = CheckResumedHeader(headerRlp);
+			m_monitor->Update(headerRlp);
+			if (isResumeHeader)
+			{
+				// the monitor took the header; later ones are checked by it
+				m_resumePoint.m_parentHash = SimpleObjects::Bytes();
+			}
+			maxPendingJobs = GetMaxPendingJobs();
+			StageMonitorState();
+		}
+
+		// Stage 2 - process receipts and dispatch events;
+		// the header has been taken by the monitor at this point, so a
+		// failure is only reported here, and the failed job is retried
+		// at stage 0 of the next block
+		std::lock_guard<std::mutex> lock(m_commitMutex);
+		try
+		{
+			CommitReceiptJobs(maxPendingJobs);
+		}
+		catch (const std::exception& e)
+		{
+			m_logger.Error(
+				std::string("Failed to process receipts, ") +
+				"no more block is taken until they are processed: " +
+				e.what()
+			);
+		}
+	}
+
+	/**
+	 * @brief Build a checkpoint of the state as of the last block whose
+	 *        events have been dispatched, encoded in Advanced RLP
+	 *
+	 */
+	virtual std::vector<uint8_t> BuildCheckpoint() override
+	{
+		static const SimpleObjects::String sk_labelSecState("SecState");
+		static const SimpleObjects::String sk_labelBlkNum("BlkNum");
+		static const SimpleObjects::String sk_labelPubSub("PubSub");
+		static const SimpleObjects::String sk_labelBlkHash("BlkHash");
+
+		// no event is dispatched while we hold the commit lock
+		std::lock_guard<std::mutex> lock(m_commitMutex);
+
+		auto snapshot = GetMonitorSnapshot();
+		if (snapshot->m_lastValidatedBlkNum.size() == 0)
+		{
+			throw std::runtime_error("No block has been processed yet");
+		}
+
+		SimpleObjects::Dict chkpt;
+		chkpt[sk_labelSecState] = *(snapshot->m_secStateRlp);
+		chkpt[sk_labelBlkNum] = snapshot->m_lastValidatedBlkNum;
+		chkpt[sk_labelBlkHash] = snapshot->m_lastValidatedBlkHash;
+		chkpt[sk_labelPubSub] = m_subSvc->BuildCheckpoint();
+
+		return AdvancedRlp::GenericWriter::Write(chkpt);
+	}
+
+	/**
+	 * @brief Make sure the chain resumed from a checkpoint extends the
+	 *        block the checkpoint was taken at; no header is taken until
+	 *        the one at the resume point, whose parent must be that block
+	 *        It must be called before any block is appended
+	 *
+	 */
+	void ExpectResumeFrom(const ResumePoint& resumePoint)
 	{
 		std::lock_guard<std::mutex> lock(m_monitorMutex);
-		m_monitor->Update(headerRlp);
+		m_resumePoint = resumePoint;
 	}
 
 	const Pubsub::SubscriberService& GetSubscriberService() const
@@ -124,27 +414,67 @@ public:
 		return *m_subSvc;
 	}
 
+	/**
+	 * @brief Get the latest published snapshot of the monitor state;
+	 *        this never blocks the block ingestion
+	 *
+	 */
+	MonitorSnapshotPtr GetMonitorSnapshot() const
+	{
+		return std::atomic_load(&m_snapshot);
+	}
+
 	EclipseMonitor::MonitorSecState GetMonitorSecState() const
 	{
-		std::lock_guard<std::mutex> lock(m_monitorMutex);
-		const auto& monitor = *m_monitor;
-		return monitor.GetMonitorSecState();
+		return GetMonitorSnapshot()->m_secState;
 	}
 
+	/**
+	 * @brief Get the number of the last block whose events have been
+	 *        dispatched
+	 *
+	 */
 	SimpleObjects::Bytes GetLastValidatedBlkNum() const
 	{
-		std::lock_guard<std::mutex> lock(m_monitorMutex);
-		return m_lastValidatedBlkNum;
+		return GetMonitorSnapshot()->m_lastValidatedBlkNum;
+	}
+
+	const EventDispatcher& GetEventDispatcher() const
+	{
+		return *m_eventDispatcher;
 	}
 
-	const EclipseMonitor::Eth::EventManager& GetEventManager() const
+	/**
+	 * @brief Counter of the live PubSub.Subscribe subscriptions
+	 *
+	 */
+	SubscriptionCounter& GetPubSubSubCounter()
 	{
-		return *m_monitor->GetEventManager();
+		return *m_pubsubSubCounter;
 	}
 
-	EclipseMonitor::Eth::EventManager& GetEventManager()
+	/**
+	 * @brief Counter of the live Receipt.Subscribe subscriptions
+	 *
+	 */
+	SubscriptionCounter& GetReceiptSubCounter()
 	{
-		return *m_monitor->GetEventManager();
+		return *m_receiptSubCounter;
+	}
+
+	/**
+	 * @brief The groups of Receipt.Subscribe subscriptions sharing one
+	 *        listener
+	 *
+	 */
+	ReceiptListenerGroups& GetReceiptListenerGroups()
+	{
+		return *m_receiptGroups;
+	}
+
+	EventDispatcher& GetEventDispatcher()
+	{
+		return *m_eventDispatcher;
 	}
 
 	const HostBlockService& GetHostBlockService() const
@@ -155,23 +485,78 @@ public:
 
 private:
 
-	void OnHeaderValidated(const EclipseMonitor::Eth::HeaderMgr& hdr)
+	/**
+	 * @brief Refuse the header at the resume point if it doesn't extend the
+	 *        block the checkpoint was taken at; the check is done before
+	 *        the monitor takes the header, since the monitor, bootstrapping
+	 *        again, doesn't report it.
+	 *        Until the header at the resume point is taken, any other
+	 *        header is refused as well, so the monitor can't bootstrap
+	 *        from a block before the resume point, nor skip past it
+	 *        without the check
+	 *        NOTE: the monitor must be locked by the caller
+	 *
+	 * @return Whether the header is the one at the resume point
+	 */
+	bool CheckResumedHeader(const std::vector<uint8_t>& headerRlp) const
 	{
-		m_lastValidatedBlkNum = hdr.GetRawHeader().get_Number();
+		// the parent hash and the number are the 1st and the 9th fields
+		static constexpr size_t sk_parentHashIdx = 0;
+		static constexpr size_t sk_numberIdx = 8;
 
-		auto receiptsMgrGetter =
-			[this](EclipseMonitor::Eth::BlockNumber blkNum)
-				-> EclipseMonitor::Eth::ReceiptsMgr
-			{
-				return EclipseMonitor::Eth::ReceiptsMgr(
-					m_hostBlkSvc->GetReceiptsRlpByNum(blkNum).AsList()
-				);
-			};
-
-		m_monitor->GetEventManager()->CheckEvents(
-			hdr,
-			receiptsMgrGetter
+		const auto& expParentHash = m_resumePoint.m_parentHash;
+		if (expParentHash.size() == 0)
+		{
+			return false;
+		}
+
+		SimpleObjects::Object hdrObj =
+			SimpleRlp::GeneralParser().Parse(headerRlp);
+		const auto& hdrList = hdrObj.AsList();
+		const uint64_t blkNum =
+			Pubsub::BlkNumFromBytes(hdrList[sk_numberIdx].AsBytes());
+		if (blkNum != m_resumePoint.m_blkNum)
+		{
+			m_logger.Error(
+				"Got block #" + std::to_string(blkNum) +
+				" before the header at the resume point (block #" +
+				std::to_string(m_resumePoint.m_blkNum) +
+				") is taken"
+			);
+			throw std::runtime_error(
+				"The header is not at the resume point"
+			);
+		}
+
+		const auto& parentHash = hdrList[sk_parentHashIdx].AsBytes();
+		if (
+			(parentHash.size() != expParentHash.size()) ||
+			!std::equal(
+				parentHash.begin(),
+				parentHash.end(),
+				expParentHash.begin()
+			)
+		)
+		{
+			m_logger.Error(
+				"The header at the resume point (block #" +
+				std::to_string(m_resumePoint.m_blkNum) +
+				") doesn't extend the block of the checkpoint"
+			);
+			throw std::runtime_error(
+				"The resumed chain doesn't extend the checkpoint"
+			);
+		}
+
+		m_logger.Info(
+			"The resumed chain extends the block of the checkpoint"
 		);
+		return true;
+	}
+
+	void OnHeaderValidated(const EclipseMonitor::Eth::HeaderMgr& hdr)
+	{
+		SubmitReceiptJob(hdr);
 
 		const auto phase = m_monitor->GetPhase();
 		switch (phase)
@@ -181,15 +566,18 @@ private:
 			{
 				// Refresh bootstrap plan first
 				// We may have a new bootstrap plan at this point
-				const auto latestBlkNum = m_hostBlkSvc->GetLatestBlockNum();
+				const auto latestBlkNum = m_latestBlkNumCache.Refresh();
 				m_monitor->RefreshBootstrapPlan(latestBlkNum);
 			}
 			break;
 
 		case EclipseMonitor::Phases::BootstrapII:
-			// we need to refresh bootstrap plan on every block
+			// we need to refresh bootstrap plan on every block,
+			// but the latest block number only needs to be accurate when
+			// we are close to the head
 			{
-				const auto latestBlkNum = m_hostBlkSvc->GetLatestBlockNum();
+				const auto latestBlkNum =
+					m_latestBlkNumCache.Get(hdr.GetNumber());
 				m_monitor->RefreshBootstrapPlan(latestBlkNum);
 			}
 			break;
@@ -199,6 +587,236 @@ private:
 		}
 	}
 
+	void SubmitReceiptJob(const EclipseMonitor::Eth::HeaderMgr& hdr)
+	{
+		m_lastSubmittedBlkNum = hdr.GetNumber();
+
+		// the version is read before the block is filtered, so a listener
+		// added in between is caught by the late check at commit time
+		const uint64_t filterVer = m_eventDispatcher->GetListenerVersion();
+
+		// receipts are only fetched if the logsBloom says there might be
+		// an event we are interested in
+		const auto match = m_eventDispatcher->Prefilter(hdr);
+
+		ReceiptJobQueue::ReceiptsPtr receipts;
+		if (match.m_isMonitorMatch)
+		{
+			// the monitor expects its events to be checked as part of the
+			// header validation; the receipts are handed to the job, so
+			// they are not fetched again
+			receipts = std::make_shared<const SimpleObjects::Object>(
+				m_hostBlkSvc->GetReceiptsRlpByNum(hdr.GetNumber())
+			);
+			m_eventDispatcher->CheckMonitorEvents(hdr, receipts->AsList());
+		}
+
+		// the rest is done in the second stage, outside of the monitor lock;
+		// the receipts trie is built and verified by the worker pool,
+		// and the events are committed in block order
+		m_receiptJobs.Submit(
+			std::make_shared<const EclipseMonitor::Eth::HeaderMgr>(hdr),
+			match.m_isListenerMatch,
+			filterVer,
+			std::move(receipts)
+		);
+	}
+
+	void CommitReceiptJob(ReceiptJobQueue::Job& job)
+	{
+		const auto& hdr = *job.m_hdr;
+
+		if (job.m_hasReceipts)
+		{
+			m_eventDispatcher->Route(hdr, job.m_logs);
+		}
+
+		// events are aged out by the latest block whose events have been
+		// dispatched, even if their event manager is quiet
+		m_subSvc->EvictPastEvents(hdr.GetNumber());
+
+		// the state of the monitor is published together with the block
+		// it belongs to
+		const auto& blkNum = hdr.GetRawHeader().get_Number();
+		const auto& blkHash = hdr.GetHash();
+		PublishSnapshot(
+			[this, &hdr, &blkNum, &blkHash](MonitorSnapshot& snapshot)
+			{
+				while (
+					!m_stagedStates.empty() &&
+					(m_stagedStates.front().m_blkNum <= hdr.GetNumber())
+				)
+				{
+					StagedMonitorState& state = m_stagedStates.front();
+					snapshot.m_secState = std::move(state.m_secState);
+					snapshot.m_secStateRlp = std::move(state.m_secStateRlp);
+					snapshot.m_phase = state.m_phase;
+					m_stagedStates.pop_front();
+				}
+				snapshot.m_lastValidatedBlkNum = blkNum;
+				snapshot.m_lastValidatedBlkHash =
+					SimpleObjects::Bytes(blkHash.begin(), blkHash.end());
+			}
+		);
+	}
+
+	/**
+	 * @brief Publish a new snapshot, which is a copy of the current one
+	 *        modified by the given function
+	 *
+	 */
+	template<typename _UpdateFunc>
+	void PublishSnapshot(_UpdateFunc&& updateFunc)
+	{
+		// writers are serialized, and the staged states are guarded by the
+		// same mutex; readers only do an atomic load
+		std::lock_guard<std::mutex> lock(m_snapshotMutex);
+
+		MonitorSnapshotPtr oldSnapshot = std::atomic_load(&m_snapshot);
+		std::shared_ptr<MonitorSnapshot> newSnapshot =
+			oldSnapshot ?
+				std::make_shared<MonitorSnapshot>(*oldSnapshot) :
+				std::make_shared<MonitorSnapshot>();
+		updateFunc(*newSnapshot);
+
+		std::atomic_store(&m_snapshot, MonitorSnapshotPtr(newSnapshot));
+	}
+
+	/**
+	 * @brief Build the state of the monitor as of now
+	 *        NOTE: the monitor must be locked by the caller
+	 *
+	 * @param lastSecState The secure state published last, or nullptr
+	 * @param lastRlp      The encoded secure state published last, which is
+	 *                     reused if the state is unchanged
+	 */
+	StagedMonitorState BuildMonitorState(
+		const EclipseMonitor::MonitorSecState* lastSecState,
+		std::shared_ptr<const SimpleObjects::Bytes> lastRlp
+	) const
+	{
+		StagedMonitorState state;
+		state.m_blkNum = m_lastSubmittedBlkNum;
+		state.m_secState = m_monitor->GetMonitorSecState();
+		state.m_phase = m_monitor->GetPhase();
+		if ((lastSecState != nullptr) && (*lastSecState == state.m_secState))
+		{
+			// keep the same buffer if the state is unchanged, so it's not
+			// encoded again, and emitters can tell a change by comparing
+			// the pointers
+			state.m_secStateRlp = std::move(lastRlp);
+		}
+		else
+		{
+			// encode it here once, rather than in every heartbeat emitter
+			state.m_secStateRlp = std::make_shared<const SimpleObjects::Bytes>(
+				AdvancedRlp::GenericWriter::Write(state.m_secState)
+			);
+		}
+		return state;
+	}
+
+	/**
+	 * @brief Publish the state of the monitor before any block is taken;
+	 *        NOTE: the monitor must be locked by the caller
+	 *
+	 */
+	void PublishMonitorState()
+	{
+		StagedMonitorState state = BuildMonitorState(nullptr, nullptr);
+		PublishSnapshot(
+			[&state](MonitorSnapshot& snapshot)
+			{
+				snapshot.m_secState = std::move(state.m_secState);
+				snapshot.m_secStateRlp = std::move(state.m_secStateRlp);
+				snapshot.m_phase = state.m_phase;
+			}
+		);
+	}
+
+	/**
+	 * @brief Keep the state of the monitor after the block just validated,
+	 *        until the events of that block are dispatched
+	 *        NOTE: the monitor must be locked by the caller
+	 *
+	 */
+	void StageMonitorState()
+	{
+		// the secure state only changes at checkpoints, so it's compared
+		// with the one staged (or published) last, and only encoded again
+		// if it has changed
+		EclipseMonitor::MonitorSecState lastSecState;
+		std::shared_ptr<const SimpleObjects::Bytes> lastRlp;
+		{
+			std::lock_guard<std::mutex> lock(m_snapshotMutex);
+			if (m_stagedStates.empty())
+			{
+				MonitorSnapshotPtr snapshot = std::atomic_load(&m_snapshot);
+				lastSecState = snapshot->m_secState;
+				lastRlp = snapshot->m_secStateRlp;
+			}
+			else
+			{
+				lastSecState = m_stagedStates.back().m_secState;
+				lastRlp = m_stagedStates.back().m_secStateRlp;
+			}
+		}
+
+		StagedMonitorState state =
+			BuildMonitorState(&lastSecState, std::move(lastRlp));
+
+		std::lock_guard<std::mutex> lock(m_snapshotMutex);
+		if (
+			!m_stagedStates.empty() &&
+			(m_stagedStates.back().m_blkNum == state.m_blkNum)
+		)
+		{
+			// no new block is validated; the state is only updated
+			m_stagedStates.back() = std::move(state);
+		}
+		else
+		{
+			m_stagedStates.push_back(std::move(state));
+		}
+	}
+
+	void CommitReceiptJobs(size_t maxPending)
+	{
+		m_receiptJobs.Commit(
+			[this](const ReceiptJobQueue::Job& job)
+			{
+				// a listener may have been added after this block has
+				// been filtered out
+				return
+					(job.m_filterVer !=
+						m_eventDispatcher->GetListenerVersion()) &&
+					m_eventDispatcher->IsListenerMatch(*job.m_hdr);
+			},
+			[this](ReceiptJobQueue::Job& job)
+			{
+				CommitReceiptJob(job);
+			},
+			maxPending
+		);
+	}
+
+	size_t GetMaxPendingJobs() const
+	{
+		// Blocks are only pipelined while we are catching up, afterwards,
+		// events should be delivered as soon as the block is validated
+		const auto phase = m_monitor->GetPhase();
+		switch (phase)
+		{
+		case EclipseMonitor::Phases::BootstrapI:
+		case EclipseMonitor::Phases::BootstrapII:
+			return EnclaveWorkerPool::GetInstance().GetNumWorkers() *
+				sk_pendingJobsPerWorker;
+
+		default:
+			return 0;
+		}
+	}
+
 	void OnHeaderConfirmed(const EclipseMonitor::Eth::HeaderMgr& hdr)
 	{
 		(void)hdr;
@@ -254,26 +872,61 @@ private:
 				secState.get_checkpointHash().GetVal()
 			);
 		const auto chkptIter = secState.get_checkpointIter().GetVal();
+		const auto numChecked = m_eventDispatcher->GetNumChecked();
+		const auto numSkipped = m_eventDispatcher->GetNumSkipped();
+		const auto numHeadQueries = m_latestBlkNumCache.GetNumRefreshed();
+		const auto pastEvStats = m_subSvc->GetPastEventStats();
+		const auto numPubSubSubs = m_pubsubSubCounter->GetNumLive();
+		const auto numReceiptSubs = m_receiptSubCounter->GetNumLive();
+		const auto numReceiptGroups = m_receiptGroups->GetNumGroups();
 
 		m_logger.Info(
 			std::string("Current Eclipse Monitor Status:\n") +
 			"\tPhase:                " + phaseStr    + ";\n" +
 			"\tGenesis Hash:         " + genesisHash + ";\n" +
 			"\tCheckpoint Hash:      " + chkptHash   + ";\n" +
-			"\tCheckpoint Iteration: " + std::to_string(chkptIter) + ";\n"
+			"\tCheckpoint Iteration: " + std::to_string(chkptIter) + ";\n" +
+			"\tReceipts Skipped:     " + std::to_string(numSkipped) +
+				" / " + std::to_string(numChecked) + " blocks;\n" +
+			"\tHead Queries:         " + std::to_string(numHeadQueries) + ";\n" +
+			"\tPast Events Retained: " +
+				std::to_string(pastEvStats.m_numRetainedEvents) + " events, " +
+				std::to_string(pastEvStats.m_numRetainedBytes) + " bytes;\n" +
+			"\tPast Events Evicted:  " +
+				std::to_string(pastEvStats.m_numEvictedEvents) + " events, " +
+				std::to_string(pastEvStats.m_numEvictedBytes) + " bytes;\n" +
+			"\tPast Events Spilled:  " +
+				std::to_string(pastEvStats.m_numSpilledChunks) + " chunks;\n" +
+			"\tLive Subscriptions:   " +
+				std::to_string(numPubSubSubs) + " PubSub, " +
+				std::to_string(numReceiptSubs) + " Receipt (" +
+				std::to_string(numReceiptGroups) + " listeners);\n"
 		);
 	}
 
 private:
 
+	std::string m_chainName;
 	DecentEnclave::Common::Logger m_logger;
 	EclipseMonitor::MonitorConfig m_monitorConfig;
 	mutable std::mutex m_monitorMutex;
 	std::unique_ptr<EclipseMonitorType> m_monitor;
+	std::shared_ptr<EventDispatcher> m_eventDispatcher;
 	uint64_t m_lastChkptIter;
+	// guarded by m_monitorMutex; cleared once the resumed chain is checked
+	ResumePoint m_resumePoint;
 	std::unique_ptr<Pubsub::SubscriberService> m_subSvc;
 	std::unique_ptr<HostBlockService> m_hostBlkSvc;
-	SimpleObjects::Bytes m_lastValidatedBlkNum;
+	LatestBlkNumCache m_latestBlkNumCache;
+	std::mutex m_snapshotMutex;
+	MonitorSnapshotPtr m_snapshot;
+	std::deque<StagedMonitorState> m_stagedStates;
+	uint64_t m_lastSubmittedBlkNum;
+	std::mutex m_commitMutex;
+	ReceiptJobQueue m_receiptJobs;
+	std::shared_ptr<SubscriptionCounter> m_pubsubSubCounter;
+	std::shared_ptr<SubscriptionCounter> m_receiptSubCounter;
+	std::shared_ptr<ReceiptListenerGroups> m_receiptGroups;
 };
 
 
@@ -0,0 +1,233 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include <DecentEnclave/Common/Logging.hpp>
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A pool of worker threads inside the enclave.
+ *        Threads can't be created inside the enclave, so the workers are
+ *        threads donated by the host, each of them enters the enclave via
+ *        an ECall (which occupies a TCS slot) and runs RunWorker() until
+ *        Terminate() is called.
+ *        If no worker is available, tasks are run by the caller.
+ *        The host may also donate spare workers, which stay idle until a
+ *        worker is reported stuck in a task, e.g., a send to a subscriber
+ *        that stopped reading, and then take over its place.
+ *
+ */
+class EnclaveWorkerPool
+{
+public: // static members:
+
+	using Task = std::function<void()>;
+
+	/**
+	 * @brief The pool used for computation, e.g., receipt verification
+	 *
+	 */
+	static EnclaveWorkerPool& GetInstance()
+	{
+		static EnclaveWorkerPool s_inst;
+		return s_inst;
+	}
+
+	/**
+	 * @brief The pool used to send messages to subscribers; it has its own
+	 *        workers, since sends can block on slow subscribers, which
+	 *        should never hold up the computation on the pool above
+	 *
+	 */
+	static EnclaveWorkerPool& GetOutboundInstance()
+	{
+		static EnclaveWorkerPool s_inst("OutboundWorkerPool");
+		return s_inst;
+	}
+
+public:
+
+	EnclaveWorkerPool(const std::string& name = "EnclaveWorkerPool") :
+		m_logger(
+			DecentEnclave::Common::LoggerFactory::GetLogger(name)
+		),
+		m_mutex(),
+		m_taskCond(),
+		m_spareCond(),
+		m_tasks(),
+		m_numWorkers(0),
+		m_numSpares(0),
+		m_numTakeovers(0),
+		m_isTerminated(false)
+	{}
+
+	~EnclaveWorkerPool() = default;
+
+	void AddTask(Task task)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if ((m_numWorkers > 0) && !m_isTerminated)
+			{
+				m_tasks.push_back(std::move(task));
+				m_taskCond.notify_one();
+				return;
+			}
+		}
+
+		// no worker available, run it by ourselves
+		RunTask(task);
+	}
+
+	/**
+	 * @brief Run as a worker until the pool is terminated;
+	 *        this is supposed to be called by the ECall that the host
+	 *        threads use to enter the enclave
+	 *
+	 */
+	void RunWorker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_isTerminated)
+		{
+			return;
+		}
+		RunTasks(lock);
+	}
+
+	/**
+	 * @brief Run as a spare worker, which waits until a worker is reported
+	 *        stuck (see TakeOverStuckWorker()), and then runs as a worker
+	 *        until the pool is terminated
+	 *
+	 */
+	void RunSpareWorker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		++m_numSpares;
+		m_spareCond.wait(
+			lock,
+			[this]() { return m_isTerminated || (m_numTakeovers > 0); }
+		);
+		--m_numSpares;
+		if (m_isTerminated)
+		{
+			return;
+		}
+		--m_numTakeovers;
+		m_logger.Info("A spare worker took over a stuck worker");
+
+		RunTasks(lock);
+	}
+
+	/**
+	 * @brief Report that a worker is stuck in a task, so a spare worker,
+	 *        if there is any, takes over its place; the stuck worker keeps
+	 *        working once its task returns
+	 *
+	 * @return false if there is no spare worker left
+	 */
+	bool TakeOverStuckWorker()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_numSpares <= m_numTakeovers)
+		{
+			m_logger.Error("A worker is stuck, but no spare worker is left");
+			return false;
+		}
+		++m_numTakeovers;
+		m_spareCond.notify_one();
+		return true;
+	}
+
+	void Terminate()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isTerminated = true;
+		m_taskCond.notify_all();
+		m_spareCond.notify_all();
+	}
+
+	size_t GetNumWorkers() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_numWorkers;
+	}
+
+private:
+
+	void RunTasks(std::unique_lock<std::mutex>& lock)
+	{
+		++m_numWorkers;
+		m_logger.Debug(
+			"Worker joined; " + std::to_string(m_numWorkers) + " workers"
+		);
+
+		while (true)
+		{
+			m_taskCond.wait(
+				lock,
+				[this]() { return m_isTerminated || !m_tasks.empty(); }
+			);
+			if (m_tasks.empty())
+			{
+				// terminated and all tasks are done
+				break;
+			}
+
+			Task task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+
+			lock.unlock();
+			RunTask(task);
+			lock.lock();
+		}
+
+		--m_numWorkers;
+	}
+
+	void RunTask(const Task& task)
+	{
+		try
+		{
+			task();
+		}
+		catch (const std::exception& e)
+		{
+			m_logger.Error(std::string("Task failed: ") + e.what());
+		}
+	}
+
+	DecentEnclave::Common::Logger m_logger;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_taskCond;
+	std::condition_variable m_spareCond;
+	std::deque<Task> m_tasks;
+	size_t m_numWorkers;
+	size_t m_numSpares;
+	size_t m_numTakeovers;
+	bool m_isTerminated;
+}; // class EnclaveWorkerPool
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,518 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <EclipseMonitor/Eth/DataTypes.hpp>
+#include <EclipseMonitor/Eth/EventManager.hpp>
+#include <EclipseMonitor/Eth/HeaderMgr.hpp>
+#include <EclipseMonitor/Eth/ReceiptsMgr.hpp>
+#include <SimpleObjects/SimpleObjects.hpp>
+
+#include "LogsBloomFilter.hpp"
+#include "ReceiptFilter.hpp"
+#include "ReceiptLog.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+using EventListenerId = uint64_t;
+
+
+using EventCallback = std::function<void(
+	const EclipseMonitor::Eth::HeaderMgr&,
+	const ReceiptLog&,
+	EventListenerId
+)>;
+
+
+struct EventDescription
+{
+	EventDescription(
+		const EclipseMonitor::Eth::ContractAddr& contractAddr,
+		const std::vector<EclipseMonitor::Eth::EventTopic>& topics,
+		EventCallback callback
+	) :
+		m_filter(ReceiptFilter::Exact(contractAddr, topics)),
+		m_callback(std::move(callback))
+	{}
+
+	EventDescription(
+		ReceiptFilter filter,
+		EventCallback callback
+	) :
+		m_filter(std::move(filter)),
+		m_callback(std::move(callback))
+	{}
+
+	ReceiptFilter m_filter;
+	EventCallback m_callback;
+}; // struct EventDescription
+
+
+/**
+ * @brief Hasher for addresses and topics; both of them are (derived from)
+ *        Keccak hashes, so the leading bytes are good enough as hash value
+ *
+ */
+struct FixedBytesHasher
+{
+	template<size_t _Size>
+	size_t operator()(const std::array<uint8_t, _Size>& bytes) const
+	{
+		static_assert(_Size >= sizeof(uint64_t), "Array is too small");
+
+		uint64_t val = 0;
+		std::memcpy(&val, bytes.data(), sizeof(val));
+		return static_cast<size_t>(val);
+	}
+}; // struct FixedBytesHasher
+
+
+/**
+ * @brief The dispatcher of the events emitted in receipts; the filters of
+ *        all listeners are compiled into one index, by contract address and
+ *        then a tree of topic positions, where each node has a child per
+ *        exact topic and one for the wildcard;
+ *        each log only walks the nodes matching its own topics (at most
+ *        2^4 of them), so the cost of routing a log depends on the number
+ *        of listeners it matches, rather than the number of listeners
+ *        The EventManager of the Eclipse Monitor is only consulted for the
+ *        events it listens to by itself (e.g., the sync event)
+ *
+ */
+class EventDispatcher
+{
+public: // static members:
+
+	using EventManager    = EclipseMonitor::Eth::EventManager;
+	using ListenerId      = EventListenerId;
+	using BloomFilterType = LogsBloomFilter<ListenerId>;
+
+	struct Listener
+	{
+		ListenerId       m_id;
+		EventDescription m_desc;
+	}; // struct Listener
+
+	using ListenerPtr  = std::shared_ptr<const Listener>;
+	using ListenerList = std::vector<ListenerId>;
+
+	/**
+	 * @brief A node of the index at a topic position; the listeners at
+	 *        the node are the ones whose filters have been fully matched
+	 *        by the topics before this position
+	 *
+	 */
+	struct TopicNode
+	{
+		TopicNode() :
+			m_listeners(),
+			m_byTopic(),
+			m_anyTopic()
+		{}
+
+		bool IsEmpty() const
+		{
+			return m_listeners.empty() &&
+				m_byTopic.empty() &&
+				(m_anyTopic == nullptr);
+		}
+
+		ListenerList               m_listeners;
+		std::unordered_map<
+			EclipseMonitor::Eth::EventTopic,
+			std::unique_ptr<TopicNode>,
+			FixedBytesHasher
+		>                          m_byTopic;
+		std::unique_ptr<TopicNode> m_anyTopic;
+	}; // struct TopicNode
+
+	using AddrIndexMap = std::unordered_map<
+		EclipseMonitor::Eth::ContractAddr,
+		TopicNode,
+		FixedBytesHasher
+	>;
+
+	struct BloomMatch
+	{
+		bool m_isMonitorMatch;
+		bool m_isListenerMatch;
+	}; // struct BloomMatch
+
+public:
+
+	EventDispatcher(std::shared_ptr<EventManager> eventMgr) :
+		m_eventMgr(std::move(eventMgr)),
+		m_monitorBloom(),
+		m_bloomFilter(),
+		m_mutex(),
+		m_nextId(0),
+		m_listeners(),
+		m_addrIndex(),
+		m_listenerVersion(0),
+		m_numChecked(0),
+		m_numSkipped(0)
+	{}
+
+	~EventDispatcher() = default;
+
+	ListenerId Listen(EventDescription eventDesc)
+	{
+		eventDesc.m_filter.Normalize();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		const ListenerId id = m_nextId++;
+
+		m_bloomFilter.Add(id, eventDesc.m_filter);
+		// changed only after the filter is updated, so a block filtered
+		// with the version read before this is either filtered with the
+		// new listener, or checked again at commit time
+		++m_listenerVersion;
+
+		for (const auto& addr : eventDesc.m_filter.m_contractAddrs)
+		{
+			InsertId(m_addrIndex[addr], eventDesc.m_filter.m_topicSets, 0, id);
+		}
+
+		m_listeners.emplace(
+			id,
+			std::make_shared<Listener>(Listener{ id, std::move(eventDesc) })
+		);
+
+		return id;
+	}
+
+	void Cancel(ListenerId id)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			auto it = m_listeners.find(id);
+			if (it == m_listeners.end())
+			{
+				return;
+			}
+			const ReceiptFilter& filter = it->second->m_desc.m_filter;
+
+			for (const auto& addr : filter.m_contractAddrs)
+			{
+				auto addrIt = m_addrIndex.find(addr);
+				if (addrIt != m_addrIndex.end())
+				{
+					EraseId(addrIt->second, filter.m_topicSets, 0, id);
+					if (addrIt->second.IsEmpty())
+					{
+						m_addrIndex.erase(addrIt);
+					}
+				}
+			}
+
+			m_listeners.erase(it);
+		}
+
+		m_bloomFilter.Remove(id);
+	}
+
+	/**
+	 * @brief Register an event that is listened to by the Eclipse Monitor
+	 *        on its own EventManager (e.g., the sync event), so that the
+	 *        receipts will be passed to the EventManager when it's possible
+	 *        to match
+	 *
+	 */
+	void AddMonitorEvent(
+		const EclipseMonitor::Eth::ContractAddr& addr,
+		const std::vector<EclipseMonitor::Eth::EventTopic>& topics
+	)
+	{
+		m_monitorBloom.AddPersistent(addr, topics);
+	}
+
+	/**
+	 * @brief Test the logsBloom of the given header against the events
+	 *        listened by the monitor and by our listeners, so the receipts
+	 *        are only fetched when a match is possible
+	 *
+	 */
+	BloomMatch Prefilter(const EclipseMonitor::Eth::HeaderMgr& hdr)
+	{
+		++m_numChecked;
+
+		const auto& bloom = hdr.GetRawHeader().get_LogsBloom();
+
+		BloomMatch match;
+		match.m_isMonitorMatch = m_monitorBloom.MayMatch(bloom);
+		match.m_isListenerMatch = m_bloomFilter.MayMatch(bloom);
+		if (!match.m_isMonitorMatch && !match.m_isListenerMatch)
+		{
+			++m_numSkipped;
+		}
+		return match;
+	}
+
+	/**
+	 * @brief Test the logsBloom of the given header against our listeners
+	 *        only, without touching the counters
+	 *
+	 */
+	bool IsListenerMatch(const EclipseMonitor::Eth::HeaderMgr& hdr) const
+	{
+		return m_bloomFilter.MayMatch(hdr.GetRawHeader().get_LogsBloom());
+	}
+
+	/**
+	 * @brief Pass the given receipts to the EventManager of the monitor
+	 *
+	 */
+	void CheckMonitorEvents(
+		const EclipseMonitor::Eth::HeaderMgr& hdr,
+		const SimpleObjects::ListBaseObj& receipts
+	)
+	{
+		m_eventMgr->CheckEvents(
+			hdr,
+			[&receipts](EclipseMonitor::Eth::BlockNumber)
+				-> EclipseMonitor::Eth::ReceiptsMgr
+			{
+				return EclipseMonitor::Eth::ReceiptsMgr(receipts);
+			}
+		);
+	}
+
+	/**
+	 * @brief Route the given (verified) logs to the interested listeners;
+	 *        the logs are routed one by one, in the order they were
+	 *        emitted, so a listener added by a callback (e.g., a Register
+	 *        event) receives the following logs in the same block, and a
+	 *        listener cancelled by a callback receives none of them
+	 *
+	 */
+	void Route(
+		const EclipseMonitor::Eth::HeaderMgr& hdr,
+		const std::vector<ReceiptLog>& logs
+	)
+	{
+		std::vector<ListenerPtr> matches;
+
+		for (const auto& log : logs)
+		{
+			matches.clear();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				auto addrIt = m_addrIndex.find(log.m_contractAddr);
+				if (addrIt != m_addrIndex.end())
+				{
+					CollectMatches(addrIt->second, log, 0, matches);
+				}
+			}
+
+			// callbacks may Listen/Cancel, so they are called without the
+			// lock
+			for (const auto& listener : matches)
+			{
+				if (!IsListening(listener->m_id))
+				{
+					// cancelled by an earlier callback
+					continue;
+				}
+				listener->m_desc.m_callback(hdr, log, listener->m_id);
+			}
+		}
+	}
+
+	/**
+	 * @brief Get a number that is changed whenever a listener is added
+	 *
+	 */
+	uint64_t GetListenerVersion() const
+	{
+		return m_listenerVersion.load();
+	}
+
+	size_t GetNumListeners() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_listeners.size();
+	}
+
+	uint64_t GetNumChecked() const
+	{
+		return m_numChecked.load();
+	}
+
+	uint64_t GetNumSkipped() const
+	{
+		return m_numSkipped.load();
+	}
+
+private:
+
+	bool IsListening(ListenerId id) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_listeners.find(id) != m_listeners.end();
+	}
+
+	static void EraseId(ListenerList& list, ListenerId id)
+	{
+		list.erase(std::remove(list.begin(), list.end(), id), list.end());
+	}
+
+	/**
+	 * @brief Add the given listener to the nodes reached by the topic sets
+	 *        starting at the given position; an OR of several topics adds
+	 *        the listener to several paths
+	 *
+	 */
+	static void InsertId(
+		TopicNode& node,
+		const std::vector<TopicSet>& topicSets,
+		size_t pos,
+		ListenerId id
+	)
+	{
+		if (pos == topicSets.size())
+		{
+			node.m_listeners.push_back(id);
+			return;
+		}
+
+		const TopicSet& topicSet = topicSets[pos];
+		if (topicSet.empty())
+		{
+			if (node.m_anyTopic == nullptr)
+			{
+				node.m_anyTopic.reset(new TopicNode());
+			}
+			InsertId(*node.m_anyTopic, topicSets, pos + 1, id);
+		}
+		for (const auto& topic : topicSet)
+		{
+			std::unique_ptr<TopicNode>& child = node.m_byTopic[topic];
+			if (child == nullptr)
+			{
+				child.reset(new TopicNode());
+			}
+			InsertId(*child, topicSets, pos + 1, id);
+		}
+	}
+
+	/**
+	 * @brief Remove the given listener from the nodes reached by the topic
+	 *        sets starting at the given position, and drop the nodes that
+	 *        are left empty
+	 *
+	 */
+	static void EraseId(
+		TopicNode& node,
+		const std::vector<TopicSet>& topicSets,
+		size_t pos,
+		ListenerId id
+	)
+	{
+		if (pos == topicSets.size())
+		{
+			EraseId(node.m_listeners, id);
+			return;
+		}
+
+		const TopicSet& topicSet = topicSets[pos];
+		if (topicSet.empty() && (node.m_anyTopic != nullptr))
+		{
+			EraseId(*node.m_anyTopic, topicSets, pos + 1, id);
+			if (node.m_anyTopic->IsEmpty())
+			{
+				node.m_anyTopic.reset();
+			}
+		}
+		for (const auto& topic : topicSet)
+		{
+			auto childIt = node.m_byTopic.find(topic);
+			if (childIt != node.m_byTopic.end())
+			{
+				EraseId(*childIt->second, topicSets, pos + 1, id);
+				if (childIt->second->IsEmpty())
+				{
+					node.m_byTopic.erase(childIt);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Collect the listeners at the given node, and at the nodes
+	 *        below it that match the topics of the log from the given
+	 *        position; since the filters are normalized, a listener is
+	 *        reached by at most one path for each log
+	 *
+	 */
+	void CollectMatches(
+		const TopicNode& node,
+		const ReceiptLog& log,
+		size_t pos,
+		std::vector<ListenerPtr>& matches
+	) const
+	{
+		for (const auto& id : node.m_listeners)
+		{
+			auto it = m_listeners.find(id);
+			if (it != m_listeners.end())
+			{
+				matches.push_back(it->second);
+			}
+		}
+
+		if (pos >= log.m_topics.size())
+		{
+			return;
+		}
+
+		auto childIt = node.m_byTopic.find(log.m_topics[pos]);
+		if (childIt != node.m_byTopic.end())
+		{
+			CollectMatches(*childIt->second, log, pos + 1, matches);
+		}
+		if (node.m_anyTopic != nullptr)
+		{
+			CollectMatches(*node.m_anyTopic, log, pos + 1, matches);
+		}
+	}
+
+	std::shared_ptr<EventManager> m_eventMgr;
+	BloomFilterType m_monitorBloom;
+	BloomFilterType m_bloomFilter;
+	mutable std::mutex m_mutex;
+	ListenerId m_nextId;
+	std::unordered_map<ListenerId, ListenerPtr> m_listeners;
+	AddrIndexMap m_addrIndex;
+	std::atomic<uint64_t> m_listenerVersion;
+	std::atomic<uint64_t> m_numChecked;
+	std::atomic<uint64_t> m_numSkipped;
+}; // class EventDispatcher
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,105 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+
+#include "HostBlockService.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A cache of the latest block number known by the host;
+ *        querying the host is an OCall plus a full header download, so
+ *        while we are far behind the head, the cached number is reused for
+ *        a number of blocks; when we get close to the cached head, it is
+ *        refreshed on every block
+ *
+ */
+class LatestBlkNumCache
+{
+public: // static members:
+
+	/**
+	 * @brief Max number of blocks the cached number can be reused for
+	 *
+	 */
+	static constexpr uint64_t sk_maxReuseBlks = 256;
+
+	/**
+	 * @brief The cache is refreshed on every block once we are this close
+	 *        to the cached head
+	 *
+	 */
+	static constexpr uint64_t sk_closeToHeadBlks = 16;
+
+public:
+
+	LatestBlkNumCache(const HostBlockService& hostBlkSvc) :
+		m_hostBlkSvc(hostBlkSvc),
+		m_latestBlkNum(0),
+		m_numReused(0),
+		m_numRefreshed(0)
+	{}
+
+	~LatestBlkNumCache() = default;
+
+	/**
+	 * @brief Get the latest block number from the host, and update the cache
+	 *
+	 */
+	uint64_t Refresh()
+	{
+		m_latestBlkNum = m_hostBlkSvc.GetLatestBlockNum();
+		m_numReused = 0;
+		++m_numRefreshed;
+		return m_latestBlkNum;
+	}
+
+	/**
+	 * @brief Get the latest block number, which is only refreshed if the
+	 *        cache is used for too many blocks, or the given block is close
+	 *        to the cached head
+	 *
+	 * @param currBlkNum The number of the block we are processing
+	 */
+	uint64_t Get(uint64_t currBlkNum)
+	{
+		if (
+			(m_numRefreshed == 0) ||
+			(m_numReused >= sk_maxReuseBlks) ||
+			(currBlkNum + sk_closeToHeadBlks >= m_latestBlkNum)
+		)
+		{
+			return Refresh();
+		}
+
+		++m_numReused;
+		return m_latestBlkNum;
+	}
+
+	uint64_t GetNumRefreshed() const
+	{
+		return m_numRefreshed;
+	}
+
+private:
+
+	const HostBlockService& m_hostBlkSvc;
+	uint64_t m_latestBlkNum;
+	uint64_t m_numReused;
+	uint64_t m_numRefreshed;
+}; // class LatestBlkNumCache
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,240 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <EclipseMonitor/Eth/DataTypes.hpp>
+#include <EclipseMonitor/Eth/Keccak256.hpp>
+
+#include "ReceiptFilter.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A filter stage that tests the 2048-bit logsBloom in a block header
+ *        against all receipt filters we are listening to,
+ *        so that receipts are only fetched when a match is possible.
+ *
+ * @tparam _KeyType The type of the key used to identify a registered entry
+ */
+template<typename _KeyType>
+class LogsBloomFilter
+{
+public: // static members:
+
+	using KeyType = _KeyType;
+
+	static constexpr size_t sk_bloomByteSize = 256;
+	static constexpr size_t sk_bloomBitMask  = (sk_bloomByteSize * 8) - 1;
+
+	/**
+	 * @brief The 3 bits set by an item in the logsBloom;
+	 *        each bit is represented by (byte index, bit mask)
+	 *
+	 */
+	using BloomBits = std::array<std::pair<size_t, uint8_t>, 3>;
+
+	/**
+	 * @brief The bits of a registered filter; the logsBloom may match if it
+	 *        has the bits of any of the addresses, and, for each non-empty
+	 *        topic set, the bits of any of the topics in that set
+	 *
+	 */
+	struct Entry
+	{
+		std::vector<BloomBits>               m_addrsBits;
+		std::vector<std::vector<BloomBits> > m_topicSetsBits;
+	}; // struct Entry
+
+	template<typename _ItemType>
+	static BloomBits ComputeBits(const _ItemType& item)
+	{
+		const auto hash = EclipseMonitor::Eth::Keccak256(item);
+
+		BloomBits bits;
+		for (size_t i = 0; i < bits.size(); ++i)
+		{
+			const size_t bitIdx = (
+				(static_cast<size_t>(hash[i * 2]) << 8) |
+				static_cast<size_t>(hash[(i * 2) + 1])
+			) & sk_bloomBitMask;
+
+			bits[i].first  = sk_bloomByteSize - 1 - (bitIdx / 8);
+			bits[i].second = static_cast<uint8_t>(1U << (bitIdx % 8));
+		}
+		return bits;
+	}
+
+	static Entry BuildEntry(const ReceiptFilter& filter)
+	{
+		Entry entry;
+		entry.m_addrsBits.reserve(filter.m_contractAddrs.size());
+		for (const auto& addr : filter.m_contractAddrs)
+		{
+			entry.m_addrsBits.push_back(ComputeBits(addr));
+		}
+		for (const auto& topicSet : filter.m_topicSets)
+		{
+			if (topicSet.empty())
+			{
+				// wildcards don't set any bit
+				continue;
+			}
+			std::vector<BloomBits> topicSetBits;
+			topicSetBits.reserve(topicSet.size());
+			for (const auto& topic : topicSet)
+			{
+				topicSetBits.push_back(ComputeBits(topic));
+			}
+			entry.m_topicSetsBits.push_back(std::move(topicSetBits));
+		}
+		return entry;
+	}
+
+	template<typename _BloomType>
+	static bool IsInBloom(const _BloomType& bloom, const BloomBits& bits)
+	{
+		for (const auto& bit : bits)
+		{
+			if ((static_cast<uint8_t>(bloom[bit.first]) & bit.second) == 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template<typename _BloomType>
+	static bool IsAnyInBloom(
+		const _BloomType& bloom,
+		const std::vector<BloomBits>& bitsList
+	)
+	{
+		for (const auto& bits : bitsList)
+		{
+			if (IsInBloom(bloom, bits))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template<typename _BloomType>
+	static bool IsInBloom(const _BloomType& bloom, const Entry& entry)
+	{
+		if (!IsAnyInBloom(bloom, entry.m_addrsBits))
+		{
+			return false;
+		}
+		for (const auto& topicSetBits : entry.m_topicSetsBits)
+		{
+			if (!IsAnyInBloom(bloom, topicSetBits))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+public:
+
+	LogsBloomFilter() :
+		m_mutex(),
+		m_persistEntries(),
+		m_entries()
+	{}
+
+	~LogsBloomFilter() = default;
+
+	/**
+	 * @brief Add an entry that will never be removed (e.g., events listened
+	 *        by the Eclipse Monitor itself)
+	 *
+	 */
+	void AddPersistent(
+		const EclipseMonitor::Eth::ContractAddr& addr,
+		const std::vector<EclipseMonitor::Eth::EventTopic>& topics
+	)
+	{
+		Entry entry = BuildEntry(ReceiptFilter::Exact(addr, topics));
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_persistEntries.push_back(std::move(entry));
+	}
+
+	void Add(const KeyType& key, const ReceiptFilter& filter)
+	{
+		Entry entry = BuildEntry(filter);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries[key] = std::move(entry);
+	}
+
+	void Remove(const KeyType& key)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_entries.erase(key);
+	}
+
+	/**
+	 * @brief Test if any of the registered entries may have emitted a log
+	 *        in the block with the given logsBloom
+	 *
+	 * @param bloom The logsBloom field of the block header
+	 * @return true if a match is possible, false if it's impossible
+	 */
+	template<typename _BloomType>
+	bool MayMatch(const _BloomType& bloom) const
+	{
+		if (bloom.size() != sk_bloomByteSize)
+		{
+			// we can't tell, so be conservative
+			return true;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto& entry : m_persistEntries)
+		{
+			if (IsInBloom(bloom, entry))
+			{
+				return true;
+			}
+		}
+		for (const auto& entry : m_entries)
+		{
+			if (IsInBloom(bloom, entry.second))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+private:
+
+	mutable std::mutex m_mutex;
+	std::vector<Entry> m_persistEntries;
+	std::unordered_map<KeyType, Entry> m_entries;
+}; // class LogsBloomFilter
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,405 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <DecentEnclave/Common/Time.hpp>
+
+#include "DataType.hpp"
+#include "EnclaveWorkerPool.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A bounded queue of messages waiting to be sent to a subscriber;
+ *        messages are sent by tasks on the outbound worker pool, so a
+ *        subscriber on a slow link doesn't block the heartbeat thread,
+ *        the receipt verification, nor the other subscribers;
+ *        a subscriber whose send doesn't finish in time, or whose queue
+ *        stays full, is disconnected, and a spare outbound worker takes
+ *        over the worker stuck in its send
+ *
+ */
+class OutboundQueue :
+	public std::enable_shared_from_this<OutboundQueue>
+{
+public: // static members:
+
+	using Frame    = std::vector<uint8_t>;
+	using FramePtr = std::shared_ptr<const Frame>;
+
+	using CloseCallback = std::function<void()>;
+
+	/**
+	 * @brief What to do when a heartbeat comes while the queue is full
+	 *        - DropHeartbeat: skip this heartbeat; the emitter keeps the
+	 *          data that would have been sent, and sends it in a later
+	 *          heartbeat
+	 *        - Disconnect: close the subscription
+	 *
+	 */
+	enum class OverflowPolicy
+	{
+		DropHeartbeat,
+		Disconnect,
+	}; // enum class OverflowPolicy
+
+	static constexpr size_t sk_defaultCapacity = 8;
+
+	struct Config
+	{
+		Config() :
+			m_capacity(sk_defaultCapacity),
+			m_policy(OverflowPolicy::DropHeartbeat),
+			m_maxFullHeartbeats(0),
+			m_sendTimeoutSec(0)
+		{}
+
+		Config(
+			size_t capacity,
+			OverflowPolicy policy,
+			uint64_t maxFullHeartbeats,
+			uint64_t sendTimeoutSec
+		) :
+			m_capacity(capacity),
+			m_policy(policy),
+			m_maxFullHeartbeats(maxFullHeartbeats),
+			m_sendTimeoutSec(sendTimeoutSec)
+		{}
+
+		/**
+		 * @brief Max number of messages queued
+		 *
+		 */
+		size_t m_capacity;
+
+		OverflowPolicy m_policy;
+
+		/**
+		 * @brief Max number of heartbeats in a row dropped by the
+		 *        DropHeartbeat policy before the subscriber is
+		 *        disconnected; 0 means unlimited
+		 *
+		 */
+		uint64_t m_maxFullHeartbeats;
+
+		/**
+		 * @brief Max number of seconds a send may take before the
+		 *        subscriber is disconnected; 0 means unlimited
+		 *
+		 */
+		uint64_t m_sendTimeoutSec;
+	}; // struct Config
+
+	static OverflowPolicy ParseOverflowPolicy(const std::string& name)
+	{
+		if (name == "DropHeartbeat")
+		{
+			return OverflowPolicy::DropHeartbeat;
+		}
+		if (name == "Disconnect")
+		{
+			return OverflowPolicy::Disconnect;
+		}
+		throw std::invalid_argument(
+			"Unknown overflow policy of outbound queue: " + name
+		);
+	}
+
+	/**
+	 * @brief The config used by the queues of new subscribers; it's set by
+	 *        the host at start up
+	 *
+	 */
+	static Config GetDefaultConfig()
+	{
+		std::lock_guard<std::mutex> lock(GetDefaultConfigMutex());
+		return GetDefaultConfigStore();
+	}
+
+	static void SetDefaultConfig(const Config& config)
+	{
+		if (config.m_capacity == 0)
+		{
+			throw std::invalid_argument(
+				"The capacity of outbound queue must be greater than 0"
+			);
+		}
+
+		std::lock_guard<std::mutex> lock(GetDefaultConfigMutex());
+		GetDefaultConfigStore() = config;
+	}
+
+	/**
+	 * @brief Max number of messages sent by one task before the worker is
+	 *        handed over to the other queues; the rest are sent by a new
+	 *        task queued behind theirs
+	 *
+	 */
+	static constexpr size_t sk_maxFramesPerDrain = 2;
+
+public:
+
+	OutboundQueue(
+		std::shared_ptr<LambdaMsgSocket> socket,
+		const Config& config = GetDefaultConfig()
+	) :
+		m_socket(std::move(socket)),
+		m_config(config),
+		m_mutex(),
+		m_frames(),
+		m_isSending(false),
+		m_isClosed(false),
+		m_sendStartTime(0),
+		m_numFullHeartbeats(0),
+		m_closeCallback()
+	{}
+
+	~OutboundQueue() = default;
+
+	/**
+	 * @brief Check if there is room for a new message; it should be called
+	 *        before the message is built, so nothing is consumed by a
+	 *        heartbeat that is dropped
+	 *
+	 *        It's also where a stalled subscriber is caught, since it's
+	 *        called on every heartbeat, while the worker sending to it is
+	 *        stuck.
+	 *
+	 * @exception std::runtime_error if the subscriber has been disconnected,
+	 *            which stops the heartbeat emitter
+	 * @return false if this heartbeat should be dropped
+	 */
+	bool HasRoom()
+	{
+		static const char* sk_errFull =
+			"The outbound queue of the subscriber is full";
+		static const char* sk_errStalled =
+			"The send to the subscriber has stalled";
+
+		const char* err = sk_errFull;
+		bool isStalled = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (m_isClosed)
+			{
+				throw std::runtime_error(
+					"The subscriber has been disconnected"
+				);
+			}
+
+			isStalled =
+				(m_config.m_sendTimeoutSec != 0) &&
+				(m_sendStartTime != 0) &&
+				(
+					DecentEnclave::Common::UntrustedTime::Timestamp() >=
+						m_sendStartTime + m_config.m_sendTimeoutSec
+				);
+			if (isStalled)
+			{
+				err = sk_errStalled;
+			}
+			else if (m_frames.size() < m_config.m_capacity)
+			{
+				m_numFullHeartbeats = 0;
+				return true;
+			}
+			else if (m_config.m_policy == OverflowPolicy::DropHeartbeat)
+			{
+				++m_numFullHeartbeats;
+				if (
+					(m_config.m_maxFullHeartbeats == 0) ||
+					(m_numFullHeartbeats < m_config.m_maxFullHeartbeats)
+				)
+				{
+					return false;
+				}
+			}
+		}
+
+		Close();
+		if (isStalled)
+		{
+			// the worker sending to this subscriber won't come back until
+			// the host gives up on the send
+			EnclaveWorkerPool::GetOutboundInstance().TakeOverStuckWorker();
+		}
+		throw std::runtime_error(err);
+	}
+
+	/**
+	 * @brief Queue the given message, and start sending if we are not
+	 *        sending already
+	 *
+	 */
+	void Push(FramePtr frame)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_isClosed)
+			{
+				throw std::runtime_error(
+					"The subscriber has been disconnected"
+				);
+			}
+
+			m_frames.push_back(std::move(frame));
+			if (m_isSending)
+			{
+				return;
+			}
+			m_isSending = true;
+		}
+
+		ScheduleDrain();
+	}
+
+	/**
+	 * @brief Set the function called once the queue is closed, which is
+	 *        supposed to tear down the subscription
+	 *
+	 */
+	void SetCloseCallback(CloseCallback closeCallback)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closeCallback = std::move(closeCallback);
+	}
+
+	/**
+	 * @brief Close the queue, e.g., when the subscriber is disconnected;
+	 *        the messages queued are dropped
+	 *
+	 */
+	void Close()
+	{
+		CloseCallback closeCallback;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_isClosed)
+			{
+				return;
+			}
+			m_isClosed = true;
+			m_frames.clear();
+			closeCallback.swap(m_closeCallback);
+		}
+
+		if (closeCallback)
+		{
+			closeCallback();
+		}
+	}
+
+private: // helper functions:
+
+	static Config& GetDefaultConfigStore()
+	{
+		static Config s_config;
+		return s_config;
+	}
+
+	static std::mutex& GetDefaultConfigMutex()
+	{
+		static std::mutex s_mutex;
+		return s_mutex;
+	}
+
+	void ScheduleDrain()
+	{
+		std::shared_ptr<OutboundQueue> self = shared_from_this();
+		EnclaveWorkerPool::GetOutboundInstance().AddTask(
+			[self]()
+			{
+				self->Drain();
+			}
+		);
+	}
+
+	void Drain()
+	{
+		for (size_t numSent = 0; ; ++numSent)
+		{
+			FramePtr frame;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_frames.empty() || m_isClosed)
+				{
+					m_isSending = false;
+					return;
+				}
+				if (numSent == sk_maxFramesPerDrain)
+				{
+					// still sending; continue in a new task, so a busy
+					// subscriber doesn't hold a worker for all its messages
+					break;
+				}
+				frame = std::move(m_frames.front());
+				m_frames.pop_front();
+				if (m_config.m_sendTimeoutSec != 0)
+				{
+					m_sendStartTime =
+						DecentEnclave::Common::UntrustedTime::Timestamp();
+				}
+			}
+
+			try
+			{
+				m_socket->SizedSendBytes(*frame);
+			}
+			catch (const std::exception&)
+			{
+				// the socket is broken or closed by the subscriber
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_isSending = false;
+					m_sendStartTime = 0;
+				}
+				Close();
+				throw;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_sendStartTime = 0;
+			}
+		}
+
+		ScheduleDrain();
+	}
+
+private:
+
+	std::shared_ptr<LambdaMsgSocket> m_socket;
+	Config m_config;
+	std::mutex m_mutex;
+	std::deque<FramePtr> m_frames;
+	bool m_isSending;
+	bool m_isClosed;
+	uint64_t m_sendStartTime;
+	uint64_t m_numFullHeartbeats;
+	CloseCallback m_closeCallback;
+}; // class OutboundQueue
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
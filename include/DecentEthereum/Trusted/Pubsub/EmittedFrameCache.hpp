@@ -0,0 +1,178 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+namespace Pubsub
+{
+
+
+/**
+ * @brief Caches the latest messages emitted to the subscribers of one event
+ *        manager (or of one list of event managers, for multiplexed
+ *        subscriptions, or of one receipt listener group);
+ *        subscribers that are at the same position of the event log get
+ *        byte-identical messages within a heartbeat, so the message, along
+ *        with the secure state in it, is only encoded once and the same
+ *        buffer is sent to all of them
+ *
+ */
+class EmittedFrameCache
+{
+public: // static members:
+
+	using Frame    = std::vector<uint8_t>;
+	using FramePtr = std::shared_ptr<const Frame>;
+
+	// the sequence numbers of the event logs followed, in the order they are
+	// followed
+	using SeqList  = std::vector<uint64_t>;
+
+	/**
+	 * @brief Max number of frames cached; a few frames are kept so the
+	 *        responses to new subscribers don't evict the heartbeat frame
+	 *
+	 */
+	static constexpr size_t sk_maxFrames = 4;
+
+public:
+
+	EmittedFrameCache() :
+		m_mutex(),
+		m_frames(),
+		m_nextSlot(0)
+	{}
+
+	~EmittedFrameCache() = default;
+
+	/**
+	 * @brief Get the frame emitted for the given state and range of events,
+	 *        or build it if it's not cached
+	 *
+	 * @param format    The format (protocol version) of the frame
+	 * @param baseKey   The state that was sent last to the subscriber, if
+	 *                  the frame only carries the changes since then;
+	 *                  otherwise, nullptr
+	 * @param stateKey  The state of the monitor that the frame is built from;
+	 *                  keys are held by the cache, so their addresses can't
+	 *                  be reused by other states while they are cached
+	 * @param beginSeq  The sequence number of the first event in the frame
+	 * @param endSeq    The sequence number after the last event in the frame
+	 * @param buildFunc The function to build the frame, if it's not cached
+	 */
+	template<typename _BuildFunc>
+	FramePtr GetOrBuild(
+		uint8_t format,
+		std::shared_ptr<const void> baseKey,
+		std::shared_ptr<const void> stateKey,
+		uint64_t beginSeq,
+		uint64_t endSeq,
+		_BuildFunc buildFunc
+	)
+	{
+		return GetOrBuild(
+			format,
+			std::move(baseKey),
+			std::move(stateKey),
+			SeqList({ beginSeq }),
+			SeqList({ endSeq }),
+			std::move(buildFunc)
+		);
+	}
+
+	/**
+	 * @brief Same as above, but for frames carrying the events of more than
+	 *        one event log
+	 *
+	 * @param beginSeqs The sequence numbers of the first events of each log
+	 * @param endSeqs   The sequence numbers after the last events of each log
+	 */
+	template<typename _BuildFunc>
+	FramePtr GetOrBuild(
+		uint8_t format,
+		std::shared_ptr<const void> baseKey,
+		std::shared_ptr<const void> stateKey,
+		SeqList beginSeqs,
+		SeqList endSeqs,
+		_BuildFunc buildFunc
+	)
+	{
+		// Concurrent callers for the same frame wait here, so it's
+		// still only built once
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for (const auto& entry : m_frames)
+		{
+			if (
+				(entry.m_format == format) &&
+				(entry.m_baseKey == baseKey) &&
+				(entry.m_stateKey == stateKey) &&
+				(entry.m_beginSeqs == beginSeqs) &&
+				(entry.m_endSeqs == endSeqs)
+			)
+			{
+				return entry.m_frame;
+			}
+		}
+
+		Entry entry{
+			format,
+			std::move(baseKey),
+			std::move(stateKey),
+			std::move(beginSeqs),
+			std::move(endSeqs),
+			std::make_shared<const Frame>(buildFunc())
+		};
+		FramePtr frame = entry.m_frame;
+
+		if (m_frames.size() < sk_maxFrames)
+		{
+			m_frames.push_back(std::move(entry));
+		}
+		else
+		{
+			m_frames[m_nextSlot] = std::move(entry);
+			m_nextSlot = (m_nextSlot + 1) % sk_maxFrames;
+		}
+
+		return frame;
+	}
+
+private: // helper types:
+
+	struct Entry
+	{
+		uint8_t m_format;
+		std::shared_ptr<const void> m_baseKey;
+		std::shared_ptr<const void> m_stateKey;
+		SeqList  m_beginSeqs;
+		SeqList  m_endSeqs;
+		FramePtr m_frame;
+	}; // struct Entry
+
+private:
+
+	std::mutex m_mutex;
+	std::vector<Entry> m_frames;
+	size_t m_nextSlot;
+}; // class EmittedFrameCache
+
+
+} // namespace Pubsub
+} // namespace Trusted
+} // namespace DecentEthereum
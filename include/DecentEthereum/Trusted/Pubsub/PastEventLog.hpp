@@ -0,0 +1,1482 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <DecentEnclave/Common/Logging.hpp>
+#include <SimpleObjects/SimpleObjects.hpp>
+#include <SimpleRlp/SimpleRlp.hpp>
+
+#include "../EnclaveWorkerPool.hpp"
+#include "../SealedSpillStore.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+namespace Pubsub
+{
+
+
+/**
+ * @brief The data structure that holds the event message and
+ *        associated metadata, as sent to the subscribers;
+ *        its structure should be
+ *        1. SimpleObjects::Bytes - The block number when the event is emitted
+ *        2. SimpleObjects::Bytes - The event message
+ *        Past events are stored as compact records instead, and are only
+ *        converted to this form when they are serialized
+ *
+ */
+using EventData  = SimpleObjects::ListT<SimpleObjects::Bytes>;
+
+
+/**
+ * @brief The data structure that holds a sequence of event data;
+ *        It could be used to
+ *        - the events that are sent to the subscribers
+ *        - the past events in a checkpoint
+ *
+ */
+using EventDataQueue = SimpleObjects::ListT<EventData>;
+
+
+/**
+ * @brief Decode a big-endian number
+ *
+ */
+template<typename _BytesType>
+inline uint64_t BlkNumFromBytes(const _BytesType& blkNumBytes)
+{
+	uint64_t blkNum = 0;
+	for (const auto& b : blkNumBytes)
+	{
+		blkNum = (blkNum << 8) | static_cast<uint8_t>(b);
+	}
+	return blkNum;
+}
+
+
+/**
+ * @brief Encode the given number in big-endian, without leading zeros
+ *
+ */
+inline SimpleObjects::Bytes BlkNumToBytes(uint64_t blkNum)
+{
+	SimpleObjects::Bytes blkNumBytes;
+	for (int shift = 56; shift >= 0; shift -= 8)
+	{
+		uint8_t b = static_cast<uint8_t>(blkNum >> shift);
+		if ((b != 0) || (blkNumBytes.size() != 0))
+		{
+			blkNumBytes.push_back(b);
+		}
+	}
+	return blkNumBytes;
+}
+
+
+/**
+ * @brief The retention policy of past events; a limit of 0 means unlimited
+ *
+ */
+struct EventRetention
+{
+	EventRetention() :
+		m_maxEvents(0),
+		m_maxBytes(0),
+		m_maxBlkAge(0)
+	{}
+
+	EventRetention(
+		uint64_t maxEvents,
+		uint64_t maxBytes,
+		uint64_t maxBlkAge
+	) :
+		m_maxEvents(maxEvents),
+		m_maxBytes(maxBytes),
+		m_maxBlkAge(maxBlkAge)
+	{}
+
+	/**
+	 * @brief Max number of events retained
+	 *
+	 */
+	uint64_t m_maxEvents;
+
+	/**
+	 * @brief Max number of bytes (block numbers and messages) retained;
+	 *        each block number counts as 8 bytes
+	 *
+	 */
+	uint64_t m_maxBytes;
+
+	/**
+	 * @brief Events emitted more than this number of blocks before the
+	 *        latest validated block are evicted
+	 *
+	 */
+	uint64_t m_maxBlkAge;
+}; // struct EventRetention
+
+
+/**
+ * @brief The policy of spilling past events to the host; the latest chunks
+ *        of events (the hot tier) are kept in the enclave, while older
+ *        chunks (the cold tier) are sealed and kept by the host, and only
+ *        paged back in when they are read
+ *
+ */
+struct EventSpill
+{
+	EventSpill() :
+		m_store(),
+		m_hotChunks(0),
+		m_maxColdChunks(0)
+	{}
+
+	EventSpill(
+		std::shared_ptr<SealedSpillStore> store,
+		uint64_t hotChunks,
+		uint64_t maxColdChunks
+	) :
+		m_store(std::move(store)),
+		m_hotChunks(hotChunks),
+		m_maxColdChunks(maxColdChunks)
+	{}
+
+	/**
+	 * @brief The store holding the cold tier; nullptr disables spilling
+	 *
+	 */
+	std::shared_ptr<SealedSpillStore> m_store;
+
+	/**
+	 * @brief Number of chunks kept in the enclave; 0 disables spilling
+	 *
+	 */
+	uint64_t m_hotChunks;
+
+	/**
+	 * @brief Max number of chunks kept by the host; once exceeded, the
+	 *        oldest chunk is evicted; 0 means unlimited
+	 *
+	 */
+	uint64_t m_maxColdChunks;
+}; // struct EventSpill
+
+
+/**
+ * @brief Counters of a past event log
+ *
+ */
+struct PastEventStats
+{
+	PastEventStats() :
+		m_numRetainedEvents(0),
+		m_numRetainedBytes(0),
+		m_numEvictedEvents(0),
+		m_numEvictedBytes(0),
+		m_numSpilledChunks(0)
+	{}
+
+	PastEventStats& operator+=(const PastEventStats& rhs)
+	{
+		m_numRetainedEvents += rhs.m_numRetainedEvents;
+		m_numRetainedBytes  += rhs.m_numRetainedBytes;
+		m_numEvictedEvents  += rhs.m_numEvictedEvents;
+		m_numEvictedBytes   += rhs.m_numEvictedBytes;
+		m_numSpilledChunks  += rhs.m_numSpilledChunks;
+		return *this;
+	}
+
+	uint64_t m_numRetainedEvents;
+	uint64_t m_numRetainedBytes;
+	uint64_t m_numEvictedEvents;
+	uint64_t m_numEvictedBytes;
+	uint64_t m_numSpilledChunks;
+}; // struct PastEventStats
+
+
+/**
+ * @brief The in-memory record of a past event; the message is kept in the
+ *        byte arena of the chunk holding the record
+ *
+ */
+struct EventRecord
+{
+	uint64_t m_blkNum;
+	uint32_t m_segIdx;
+	uint32_t m_offset;
+	uint64_t m_size;
+}; // struct EventRecord
+
+
+/**
+ * @brief The number of blocks of AppendOnlySlots, where each block after
+ *        the first one doubles the total size
+ *
+ */
+inline constexpr size_t CountAppendOnlyBlocks(
+	size_t capacity,
+	size_t firstBlockSize
+)
+{
+	return (capacity <= firstBlockSize) ?
+		1 :
+		(1 + CountAppendOnlyBlocks(capacity / 2, firstBlockSize));
+}
+
+
+/**
+ * @brief A fixed-capacity array that is only appended to; its slots are
+ *        allocated in blocks of growing sizes (4, 4, 8, 16, ...), so an
+ *        array with few items stays small, and items never move once
+ *        appended, so the filled slots can be read while others are being
+ *        appended
+ *
+ */
+template<typename _ItemType, size_t _Capacity>
+class AppendOnlySlots
+{
+public: // static members:
+
+	static constexpr size_t sk_firstBlockSize = 4;
+
+	static constexpr size_t sk_capacity = _Capacity;
+
+	static_assert(
+		(sk_capacity >= sk_firstBlockSize) &&
+		((sk_capacity / sk_firstBlockSize) * sk_firstBlockSize == sk_capacity) &&
+		(((sk_capacity / sk_firstBlockSize) &
+			((sk_capacity / sk_firstBlockSize) - 1)) == 0),
+		"The capacity must be the size of the first block times a power of 2"
+	);
+
+public:
+
+	AppendOnlySlots() :
+		m_size(0),
+		m_blocks()
+	{}
+
+	~AppendOnlySlots() = default;
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	void push_back(_ItemType item)
+	{
+		if (m_size >= sk_capacity)
+		{
+			throw std::logic_error("Append-only slots are full");
+		}
+
+		const std::pair<size_t, size_t> loc = Locate(m_size);
+		if (loc.second == 0)
+		{
+			m_blocks[loc.first].reset(new _ItemType[GetBlockSize(loc.first)]);
+		}
+		m_blocks[loc.first][loc.second] = std::move(item);
+		++m_size;
+	}
+
+	_ItemType& operator[](size_t idx)
+	{
+		const std::pair<size_t, size_t> loc = Locate(idx);
+		return m_blocks[loc.first][loc.second];
+	}
+
+	const _ItemType& operator[](size_t idx) const
+	{
+		const std::pair<size_t, size_t> loc = Locate(idx);
+		return m_blocks[loc.first][loc.second];
+	}
+
+	_ItemType& back()
+	{
+		return (*this)[m_size - 1];
+	}
+
+private: // helper functions:
+
+	static size_t GetBlockSize(size_t blockIdx)
+	{
+		return (blockIdx == 0) ?
+			sk_firstBlockSize :
+			(sk_firstBlockSize << (blockIdx - 1));
+	}
+
+	/**
+	 * @return The index of the block holding the given slot, and the index
+	 *         of the slot in that block
+	 */
+	static std::pair<size_t, size_t> Locate(size_t idx)
+	{
+		if (idx < sk_firstBlockSize)
+		{
+			return std::make_pair(size_t(0), idx);
+		}
+
+		// block i (i > 0) begins at the slot equal to its size
+		size_t blockIdx = 1;
+		size_t blockBegin = sk_firstBlockSize;
+		while (idx >= (blockBegin * 2))
+		{
+			blockBegin *= 2;
+			++blockIdx;
+		}
+		return std::make_pair(blockIdx, idx - blockBegin);
+	}
+
+private:
+
+	size_t m_size;
+	std::array<
+		std::unique_ptr<_ItemType[]>,
+		CountAppendOnlyBlocks(_Capacity, sk_firstBlockSize)
+	> m_blocks;
+}; // class AppendOnlySlots
+
+
+/**
+ * @brief A fixed-capacity chunk of past events; events are only appended
+ *        to the free slots at the end, so a slot, once filled, is never
+ *        modified again and can be read without any lock
+ *        The messages are packed into the segments of a byte arena, which
+ *        never move once allocated; the first segment is sized to the first
+ *        message, and each new one doubles in size up to sk_segmentSize,
+ *        so a chunk of a few small events stays small, while a chunk of
+ *        many small events costs only a few allocations
+ *
+ */
+class PastEventChunk
+{
+public: // static members:
+
+	static constexpr size_t sk_capacity = 64;
+
+	static constexpr size_t sk_segmentSize = 4096;
+
+	/**
+	 * @brief Restore a chunk from the bytes given by Serialize()
+	 *
+	 */
+	static std::shared_ptr<const PastEventChunk> Deserialize(
+		const std::vector<uint8_t>& rlp
+	)
+	{
+		SimpleObjects::Object obj = SimpleRlp::GeneralParser().Parse(rlp);
+		const auto& evList = obj.AsList();
+		if (evList.size() > sk_capacity)
+		{
+			throw std::runtime_error("Serialized past event chunk is too large");
+		}
+
+		std::shared_ptr<PastEventChunk> chunk =
+			std::make_shared<PastEventChunk>();
+		for (const auto& evObj : evList)
+		{
+			const auto& evFields = evObj.AsList();
+			if (evFields.size() != 2)
+			{
+				throw std::runtime_error("Serialized past event is malformed");
+			}
+			const auto& blkNum = evFields[0].AsBytes();
+			const auto& evMsg = evFields[1].AsBytes();
+
+			chunk->Append(
+				BlkNumFromBytes(blkNum),
+				std::vector<uint8_t>(evMsg.begin(), evMsg.end())
+			);
+		}
+		return chunk;
+	}
+
+public:
+
+	PastEventChunk() :
+		m_records(),
+		m_segUsed(0),
+		m_segments()
+	{}
+
+	~PastEventChunk() = default;
+
+	/**
+	 * @brief Append an event to this chunk;
+	 *        only the owning log is allowed to call this, while holding
+	 *        its lock
+	 *
+	 */
+	void Append(uint64_t blkNum, const std::vector<uint8_t>& evMsg)
+	{
+		if (IsFull())
+		{
+			throw std::logic_error("Past event chunk is full");
+		}
+
+		if (
+			(m_segments.size() == 0) ||
+			(m_segUsed + evMsg.size() > m_segments.back().m_size)
+		)
+		{
+			// there are at most as many segments as events
+			const size_t segSize = (m_segments.size() == 0) ?
+				evMsg.size() :
+				std::max(
+					std::min(sk_segmentSize, m_segments.back().m_size * 2),
+					evMsg.size()
+				);
+			m_segments.push_back(Segment(segSize));
+			m_segUsed = 0;
+		}
+
+		const uint32_t segIdx = static_cast<uint32_t>(m_segments.size() - 1);
+		std::copy(
+			evMsg.begin(),
+			evMsg.end(),
+			m_segments[segIdx].m_data.get() + m_segUsed
+		);
+		m_records.push_back(EventRecord{
+			blkNum,
+			segIdx,
+			static_cast<uint32_t>(m_segUsed),
+			evMsg.size()
+		});
+		m_segUsed += evMsg.size();
+	}
+
+	bool IsFull() const
+	{
+		return m_records.size() >= sk_capacity;
+	}
+
+	const EventRecord& operator[](size_t idx) const
+	{
+		return m_records[idx];
+	}
+
+	const uint8_t* GetMsg(const EventRecord& record) const
+	{
+		return m_segments[record.m_segIdx].m_data.get() + record.m_offset;
+	}
+
+	/**
+	 * @brief Convert the event at the given slot to the form sent to the
+	 *        subscribers
+	 *
+	 */
+	EventData ToEventData(size_t idx) const
+	{
+		const EventRecord& record = m_records[idx];
+		const uint8_t* msg = GetMsg(record);
+		return EventData({
+			BlkNumToBytes(record.m_blkNum),
+			EventData::value_type(msg, msg + record.m_size),
+		});
+	}
+
+	/**
+	 * @brief Serialize the events in this chunk, so it can be spilled to
+	 *        the host; only full chunks, which are never modified again,
+	 *        are allowed to be serialized without holding the lock of the
+	 *        owning log
+	 *
+	 */
+	std::vector<uint8_t> Serialize() const
+	{
+		EventDataQueue events;
+		events.reserve(m_records.size());
+		for (size_t i = 0; i < m_records.size(); ++i)
+		{
+			events.push_back(ToEventData(i));
+		}
+		return SimpleRlp::WriteRlp(events);
+	}
+
+private: // helper types:
+
+	struct Segment
+	{
+		Segment() :
+			m_size(0),
+			m_data()
+		{}
+
+		explicit Segment(size_t size) :
+			m_size(size),
+			m_data(new uint8_t[size])
+		{}
+
+		size_t m_size;
+		std::unique_ptr<uint8_t[]> m_data;
+	}; // struct Segment
+
+private:
+
+	// only accessed by the owning log, while holding its lock
+	AppendOnlySlots<EventRecord, sk_capacity> m_records;
+	size_t m_segUsed;
+	AppendOnlySlots<Segment, sk_capacity> m_segments;
+}; // class PastEventChunk
+
+
+/**
+ * @brief A snapshot of a past event log, which is only a list of
+ *        chunk pointers plus the range of events in them;
+ *        it keeps the chunks alive, so it stays valid after the events
+ *        are evicted from the log
+ *        Every event appended to a log is given a sequence number, starting
+ *        from 0; the snapshot covers the events in [BeginSeq, EndSeq)
+ *
+ */
+class PastEventSnapshot
+{
+public:
+
+	using ChunkPtr = std::shared_ptr<const PastEventChunk>;
+
+public:
+
+	PastEventSnapshot() :
+		m_chunks(),
+		m_offset(0),
+		m_size(0),
+		m_beginSeq(0)
+	{}
+
+	PastEventSnapshot(
+		std::vector<ChunkPtr> chunks,
+		size_t offset,
+		size_t size,
+		uint64_t beginSeq
+	) :
+		m_chunks(std::move(chunks)),
+		m_offset(offset),
+		m_size(size),
+		m_beginSeq(beginSeq)
+	{}
+
+	~PastEventSnapshot() = default;
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	uint64_t GetBeginSeq() const
+	{
+		return m_beginSeq;
+	}
+
+	uint64_t GetEndSeq() const
+	{
+		return m_beginSeq + m_size;
+	}
+
+	/**
+	 * @brief Call the given function on each event in this snapshot,
+	 *        from the oldest to the latest, with the chunk holding the
+	 *        event and the slot of the event in that chunk
+	 *
+	 */
+	template<typename _Func>
+	void ForEach(_Func func) const
+	{
+		for (size_t i = 0; i < m_size; ++i)
+		{
+			const size_t pos = m_offset + i;
+			func(
+				*m_chunks[pos / PastEventChunk::sk_capacity],
+				pos % PastEventChunk::sk_capacity
+			);
+		}
+	}
+
+	EventDataQueue ToEventDataQueue() const
+	{
+		EventDataQueue events;
+		events.reserve(m_size);
+		ForEach(
+			[&events](const PastEventChunk& chunk, size_t idx)
+			{
+				events.push_back(chunk.ToEventData(idx));
+			}
+		);
+		return events;
+	}
+
+private:
+
+	std::vector<ChunkPtr> m_chunks;
+	size_t m_offset;
+	size_t m_size;
+	uint64_t m_beginSeq;
+}; // class PastEventSnapshot
+
+
+/**
+ * @brief What a past event log keeps in a checkpoint; the spilled chunks
+ *        are kept by the host across runs, so only their keys are saved,
+ *        instead of paging them in
+ *
+ */
+struct PastEventCheckpoint
+{
+	PastEventCheckpoint() :
+		m_hotEvents(),
+		m_firstSeq(0),
+		m_spillKeys(),
+		m_spillOffset(0)
+	{}
+
+	/**
+	 * @brief The retained events in the hot tier
+	 *
+	 */
+	PastEventSnapshot m_hotEvents;
+
+	/**
+	 * @brief The sequence number of the first retained event, which may be
+	 *        in a spilled chunk
+	 *
+	 */
+	uint64_t m_firstSeq;
+
+	/**
+	 * @brief The keys of the spilled chunks, from the oldest one
+	 *
+	 */
+	std::vector<uint64_t> m_spillKeys;
+
+	/**
+	 * @brief The number of evicted events in the oldest spilled chunk
+	 *
+	 */
+	size_t m_spillOffset;
+}; // struct PastEventCheckpoint
+
+
+/**
+ * @brief The past events emitted by one event manager, kept in an
+ *        append-only list of refcounted chunks; the oldest events are
+ *        evicted once any of the limits given by the retention policy is
+ *        exceeded, and a chunk is dropped once all its events are evicted
+ *        Chunks older than the hot tier are sealed and spilled to the host
+ *        by the worker pool, and paged back in only when a snapshot reaches
+ *        back to them
+ *        It must be owned by a shared pointer, which is held by the
+ *        spilling tasks
+ *
+ */
+class PastEventLog :
+	public std::enable_shared_from_this<PastEventLog>
+{
+public:
+
+	/**
+	 * @param firstSeq The sequence number of the first event appended; it's
+	 *                 only non-zero for a log restored from a checkpoint,
+	 *                 so the sequence numbers known by the subscribers stay
+	 *                 valid
+	 */
+	PastEventLog(
+		const EventRetention& retention,
+		const EventSpill& spill = EventSpill(),
+		uint64_t firstSeq = 0
+	) :
+		m_logger(
+			DecentEnclave::Common::LoggerFactory::GetLogger("PastEventLog")
+		),
+		m_retention(retention),
+		m_spill(spill),
+		m_mutex(),
+		m_chunks(),
+		m_offset(0),
+		m_numEvents(0),
+		m_firstSeq(firstSeq),
+		m_firstChunkIdx(0),
+		m_numColdChunks(0),
+		m_lastEvictedBlkNum(0),
+		m_isLastEvictedKnown(false),
+		m_isSpilling(false),
+		m_stats()
+	{}
+
+	// the spilled chunks are kept by the host, since the latest checkpoint
+	// may refer to them
+	~PastEventLog() = default;
+
+	void Append(uint64_t blkNum, const std::vector<uint8_t>& evMsg)
+	{
+		const uint64_t evSize = sizeof(blkNum) + evMsg.size();
+
+		std::vector<uint64_t> evictedKeys;
+		bool isSpillNeeded = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			// the last chunk is always in the hot tier, unless only spilled
+			// chunks are restored from a checkpoint, which are full
+			if (
+				m_chunks.empty() ||
+				(m_chunks.back().m_hotChunk == nullptr) ||
+				m_chunks.back().m_hotChunk->IsFull()
+			)
+			{
+				m_chunks.emplace_back();
+			}
+			ChunkSlot& lastSlot = m_chunks.back();
+			lastSlot.m_meta.push_back(EntryMeta{ blkNum, evSize });
+			lastSlot.m_hotChunk->Append(blkNum, evMsg);
+			++m_numEvents;
+			++m_stats.m_numRetainedEvents;
+			m_stats.m_numRetainedBytes += evSize;
+
+			EvictExpired(blkNum, evictedKeys);
+
+			if (IsHotTierFull() && !m_isSpilling)
+			{
+				m_isSpilling = true;
+				isSpillNeeded = true;
+			}
+		}
+
+		// talk to the host without holding the lock
+		for (const auto& key : evictedKeys)
+		{
+			RemoveSpilled(key);
+		}
+		if (isSpillNeeded)
+		{
+			// sealing the chunk and passing it to the host are left to the
+			// worker pool, so they don't hold up the committing of blocks
+			std::shared_ptr<PastEventLog> self = shared_from_this();
+			EnclaveWorkerPool::GetInstance().AddTask(
+				[self]()
+				{
+					self->SpillHotOverflow();
+				}
+			);
+		}
+	}
+
+	/**
+	 * @brief Restore the spilled chunks saved in a checkpoint; it must be
+	 *        called before any event is appended
+	 *        The chunks are loaded from the host one at a time, and sealed
+	 *        again under the labels of this run; a chunk that can't be
+	 *        restored is treated as evicted, along with all the chunks
+	 *        before it
+	 *
+	 * @param labelPrefix The label prefix of the run that spilled them
+	 */
+	void RestoreSpilled(
+		const std::string& labelPrefix,
+		const std::vector<uint64_t>& keys,
+		size_t offset
+	)
+	{
+		// no one else can access the log yet, so the lock is held while
+		// talking to the host
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_chunks.empty())
+		{
+			throw std::logic_error(
+				"Spilled past events must be restored before any append"
+			);
+		}
+		if (keys.empty())
+		{
+			return;
+		}
+		if (m_spill.m_store == nullptr)
+		{
+			m_logger.Error(
+				"Spilling is disabled; spilled past events are dropped"
+			);
+			m_firstSeq +=
+				(keys.size() * PastEventChunk::sk_capacity) - offset;
+			m_firstChunkIdx += keys.size();
+			return;
+		}
+
+		// the keys given to the chunks sealed again must not overwrite the
+		// ones that are not loaded yet
+		m_spill.m_store->ReserveKeys(
+			*std::max_element(keys.begin(), keys.end()) + 1
+		);
+
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			const size_t numSkipped = (i == 0) ? offset : 0;
+
+			std::shared_ptr<const PastEventChunk> chunk;
+			uint64_t key = 0;
+			try
+			{
+				const std::vector<uint8_t> chunkBytes =
+					m_spill.m_store->Load(keys[i], labelPrefix);
+				chunk = PastEventChunk::Deserialize(chunkBytes);
+				if (!chunk->IsFull())
+				{
+					// only full chunks are spilled
+					throw std::runtime_error(
+						"Spilled past event chunk is truncated"
+					);
+				}
+				key = m_spill.m_store->Store(chunkBytes);
+			}
+			catch (const std::exception& e)
+			{
+				m_logger.Error(
+					std::string("Failed to restore spilled past events: ") +
+					e.what()
+				);
+
+				// events must be retained without gaps, so the chunks
+				// restored so far are dropped as well
+				for (const auto& slot : m_chunks)
+				{
+					RemoveSpilled(slot.m_spillKey);
+				}
+				m_firstSeq +=
+					m_numEvents + PastEventChunk::sk_capacity - numSkipped;
+				m_firstChunkIdx += m_chunks.size() + 1;
+				m_chunks.clear();
+				m_offset = 0;
+				m_numEvents = 0;
+				m_numColdChunks = 0;
+				m_stats = PastEventStats();
+
+				RemoveSpilled(keys[i]);
+				continue;
+			}
+			RemoveSpilled(keys[i]);
+
+			if (m_chunks.empty())
+			{
+				m_offset = numSkipped;
+			}
+			m_chunks.emplace_back(key);
+			ChunkSlot& slot = m_chunks.back();
+			slot.m_meta.reserve(PastEventChunk::sk_capacity);
+			for (size_t j = 0; j < PastEventChunk::sk_capacity; ++j)
+			{
+				const EventRecord& record = (*chunk)[j];
+				const uint64_t evSize = sizeof(record.m_blkNum) + record.m_size;
+				slot.m_meta.push_back(EntryMeta{ record.m_blkNum, evSize });
+				if (j >= numSkipped)
+				{
+					++m_numEvents;
+					++m_stats.m_numRetainedEvents;
+					m_stats.m_numRetainedBytes += evSize;
+				}
+			}
+			++m_numColdChunks;
+			++m_stats.m_numSpilledChunks;
+		}
+	}
+
+	/**
+	 * @brief Evict the events that are older than the max block age as of
+	 *        the given block; Append only does so when an event is
+	 *        appended, so this is called on every committed block to age
+	 *        out the events of quiet event managers as well
+	 *
+	 */
+	void EvictByAge(uint64_t latestBlkNum)
+	{
+		if (m_retention.m_maxBlkAge == 0)
+		{
+			return;
+		}
+
+		std::vector<uint64_t> evictedKeys;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			EvictExpired(latestBlkNum, evictedKeys);
+		}
+
+		// talk to the host without holding the lock
+		for (const auto& key : evictedKeys)
+		{
+			RemoveSpilled(key);
+		}
+	}
+
+	/**
+	 * @brief Take a snapshot of the retained events; it only copies the
+	 *        chunk pointers, so the lock is held for a short time only
+	 *
+	 */
+	PastEventSnapshot GetSnapshot() const
+	{
+		return GetSnapshot(0);
+	}
+
+	/**
+	 * @brief Take a snapshot of the retained events whose sequence number
+	 *        is not less than the given one; if some of these events have
+	 *        been evicted already, the snapshot begins from the oldest
+	 *        retained event instead
+	 *        Spilled chunks in the range are paged in without holding the
+	 *        lock
+	 *
+	 */
+	PastEventSnapshot GetSnapshot(uint64_t fromSeq) const
+	{
+		std::vector<PastEventSnapshot::ChunkPtr> chunks;
+		// (index in chunks, spill key) of the chunks to be paged in
+		std::vector<std::pair<size_t, uint64_t> > coldChunks;
+		uint64_t firstChunkIdx = 0;
+		size_t offset = 0;
+		size_t size = 0;
+		uint64_t beginSeq = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			const uint64_t endSeq = m_firstSeq + m_numEvents;
+			beginSeq = std::min(std::max(fromSeq, m_firstSeq), endSeq);
+			const size_t skipped = static_cast<size_t>(beginSeq - m_firstSeq);
+
+			offset = m_offset + skipped;
+			size = m_numEvents - skipped;
+			const size_t firstChunk = offset / PastEventChunk::sk_capacity;
+			offset = offset % PastEventChunk::sk_capacity;
+			firstChunkIdx = m_firstChunkIdx + firstChunk;
+
+			for (size_t i = firstChunk; i < m_chunks.size(); ++i)
+			{
+				const ChunkSlot& slot = m_chunks[i];
+				if (slot.m_hotChunk != nullptr)
+				{
+					chunks.push_back(slot.m_hotChunk);
+					continue;
+				}
+
+				chunks.push_back(slot.m_pagedChunk.lock());
+				if (chunks.back() == nullptr)
+				{
+					coldChunks.emplace_back(chunks.size() - 1, slot.m_spillKey);
+				}
+			}
+		}
+
+		if (coldChunks.empty())
+		{
+			return PastEventSnapshot(std::move(chunks), offset, size, beginSeq);
+		}
+
+		for (const auto& coldChunk : coldChunks)
+		{
+			try
+			{
+				chunks[coldChunk.first] = PageIn(coldChunk.second);
+			}
+			catch (const std::exception&)
+			{
+				if (!IsChunkEvicted(firstChunkIdx + coldChunk.first))
+				{
+					throw;
+				}
+				// the chunk was evicted (and removed from the host) after
+				// the chunk list was copied, so we start over
+				return GetSnapshot(fromSeq);
+			}
+		}
+
+		{
+			// let other readers share the chunks paged in, as long as
+			// they are held by someone
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (const auto& coldChunk : coldChunks)
+			{
+				const uint64_t chunkIdx = firstChunkIdx + coldChunk.first;
+				if (
+					(chunkIdx >= m_firstChunkIdx) &&
+					(chunkIdx - m_firstChunkIdx < m_numColdChunks)
+				)
+				{
+					m_chunks[chunkIdx - m_firstChunkIdx].m_pagedChunk =
+						chunks[coldChunk.first];
+				}
+			}
+		}
+
+		return PastEventSnapshot(std::move(chunks), offset, size, beginSeq);
+	}
+
+	/**
+	 * @brief Get what should be kept in a checkpoint; no spilled chunk is
+	 *        paged in
+	 *
+	 */
+	PastEventCheckpoint GetCheckpoint() const
+	{
+		PastEventCheckpoint chkpt;
+		std::vector<PastEventSnapshot::ChunkPtr> hotChunks;
+		size_t offset = 0;
+		size_t size = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			chkpt.m_firstSeq = m_firstSeq;
+			offset = m_offset;
+			size = m_numEvents;
+			for (size_t i = 0; i < m_chunks.size(); ++i)
+			{
+				if (i < m_numColdChunks)
+				{
+					chkpt.m_spillKeys.push_back(m_chunks[i].m_spillKey);
+				}
+				else
+				{
+					hotChunks.push_back(m_chunks[i].m_hotChunk);
+				}
+			}
+		}
+
+		// the spilled chunks are full
+		size_t numSpilled = 0;
+		if (!chkpt.m_spillKeys.empty())
+		{
+			numSpilled =
+				(chkpt.m_spillKeys.size() * PastEventChunk::sk_capacity) -
+				offset;
+			chkpt.m_spillOffset = offset;
+			offset = 0;
+		}
+		chkpt.m_hotEvents = PastEventSnapshot(
+			std::move(hotChunks),
+			offset,
+			size - numSpilled,
+			chkpt.m_firstSeq + numSpilled
+		);
+		return chkpt;
+	}
+
+	/**
+	 * @brief Find the first retained event emitted at or after the given
+	 *        block; events are appended in block order, and their metadata
+	 *        is always in the enclave, so no chunk is paged in
+	 *
+	 * @return The sequence number of the event, or the end sequence number
+	 *         if there is no such event
+	 */
+	uint64_t FindSeqByBlkNum(uint64_t blkNum) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		size_t low = 0;
+		size_t high = m_numEvents;
+		while (low < high)
+		{
+			const size_t mid = low + ((high - low) / 2);
+			const size_t pos = m_offset + mid;
+			const EntryMeta& meta =
+				m_chunks[pos / PastEventChunk::sk_capacity].
+					m_meta[pos % PastEventChunk::sk_capacity];
+			if (meta.m_blkNum < blkNum)
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+		return m_firstSeq + low;
+	}
+
+	/**
+	 * @brief Check if any event emitted at or after the given block may
+	 *        have been evicted, i.e., if the events found by
+	 *        FindSeqByBlkNum may not be all the events since that block
+	 *
+	 */
+	bool IsEvictedSince(uint64_t blkNum) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_isLastEvictedKnown)
+		{
+			return blkNum <= m_lastEvictedBlkNum;
+		}
+		if (m_firstSeq == 0)
+		{
+			// nothing has been evicted
+			return false;
+		}
+		// the log is restored from a checkpoint, and the events before it
+		// were emitted at or before the oldest retained one
+		return
+			(m_numEvents == 0) ||
+			(blkNum <= m_chunks.front().m_meta[m_offset].m_blkNum);
+	}
+
+	PastEventStats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_stats;
+	}
+
+private: // helper types:
+
+	struct EntryMeta
+	{
+		uint64_t m_blkNum;
+		uint64_t m_size;
+	}; // struct EntryMeta
+
+	/**
+	 * @brief A chunk in the log; the metadata of the events is always
+	 *        kept in the enclave, so events can be evicted without paging
+	 *        their chunk in
+	 *
+	 */
+	struct ChunkSlot
+	{
+		ChunkSlot() :
+			m_hotChunk(std::make_shared<PastEventChunk>()),
+			m_pagedChunk(),
+			m_spillKey(0),
+			m_meta()
+		{}
+
+		/**
+		 * @brief A slot of a chunk that is already spilled
+		 *
+		 */
+		explicit ChunkSlot(uint64_t spillKey) :
+			m_hotChunk(),
+			m_pagedChunk(),
+			m_spillKey(spillKey),
+			m_meta()
+		{}
+
+		/**
+		 * @brief The chunk, if it's in the hot tier; nullptr once it's
+		 *        spilled to the host
+		 *
+		 */
+		std::shared_ptr<PastEventChunk> m_hotChunk;
+
+		/**
+		 * @brief The copy of a spilled chunk that is still held by some
+		 *        snapshots; it's only a cache, so it's updated by readers
+		 *
+		 */
+		mutable std::weak_ptr<const PastEventChunk> m_pagedChunk;
+
+		uint64_t m_spillKey;
+
+		/**
+		 * @brief The metadata of the events in the chunk, in order; it only
+		 *        grows as the chunk fills
+		 *
+		 */
+		std::vector<EntryMeta> m_meta;
+	}; // struct ChunkSlot
+
+private: // helper functions:
+
+	bool IsExpired(uint64_t oldestBlkNum, uint64_t latestBlkNum) const
+	{
+		return
+			(
+				(m_retention.m_maxEvents != 0) &&
+				(m_stats.m_numRetainedEvents > m_retention.m_maxEvents)
+			) ||
+			(
+				(m_retention.m_maxBytes != 0) &&
+				(m_stats.m_numRetainedBytes > m_retention.m_maxBytes)
+			) ||
+			(
+				(m_retention.m_maxBlkAge != 0) &&
+				(oldestBlkNum + m_retention.m_maxBlkAge < latestBlkNum)
+			) ||
+			(
+				(m_spill.m_maxColdChunks != 0) &&
+				(m_numColdChunks > m_spill.m_maxColdChunks)
+			);
+	}
+
+	bool IsHotTierFull() const
+	{
+		return
+			(m_spill.m_store != nullptr) &&
+			(m_spill.m_hotChunks != 0) &&
+			(m_chunks.size() - m_numColdChunks > m_spill.m_hotChunks);
+	}
+
+	bool IsChunkEvicted(uint64_t chunkIdx) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return chunkIdx < m_firstChunkIdx;
+	}
+
+	/**
+	 * @param evictedKeys The keys of the spilled chunks that are evicted,
+	 *                    which should be removed from the host
+	 */
+	void EvictExpired(
+		uint64_t latestBlkNum,
+		std::vector<uint64_t>& evictedKeys
+	)
+	{
+		while (
+			(m_numEvents > 0) &&
+			IsExpired(m_chunks.front().m_meta[m_offset].m_blkNum, latestBlkNum)
+		)
+		{
+			const uint64_t oldestSize = m_chunks.front().m_meta[m_offset].m_size;
+			m_lastEvictedBlkNum = m_chunks.front().m_meta[m_offset].m_blkNum;
+			m_isLastEvictedKnown = true;
+
+			--m_stats.m_numRetainedEvents;
+			m_stats.m_numRetainedBytes -= oldestSize;
+			++m_stats.m_numEvictedEvents;
+			m_stats.m_numEvictedBytes += oldestSize;
+
+			--m_numEvents;
+			++m_firstSeq;
+			++m_offset;
+			if (m_offset == PastEventChunk::sk_capacity)
+			{
+				// the whole chunk is evicted; snapshots taken earlier may
+				// still hold it
+				if (m_numColdChunks > 0)
+				{
+					// spilled chunks always come first
+					evictedKeys.push_back(m_chunks.front().m_spillKey);
+					--m_numColdChunks;
+					--m_stats.m_numSpilledChunks;
+				}
+				m_chunks.pop_front();
+				++m_firstChunkIdx;
+				m_offset = 0;
+			}
+		}
+	}
+
+	/**
+	 * @brief Spill the oldest chunks in the hot tier, until it's no longer
+	 *        over its size; only one such task runs for a log at a time
+	 *
+	 */
+	void SpillHotOverflow()
+	{
+		while (true)
+		{
+			uint64_t chunkIdx = 0;
+			std::shared_ptr<const PastEventChunk> chunk;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!IsHotTierFull())
+				{
+					m_isSpilling = false;
+					return;
+				}
+				chunkIdx = m_firstChunkIdx + m_numColdChunks;
+				chunk = m_chunks[m_numColdChunks].m_hotChunk;
+			}
+
+			if (!Spill(chunkIdx, std::move(chunk)))
+			{
+				// the chunk stays in the hot tier, and will be tried again
+				// at the next append
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_isSpilling = false;
+				return;
+			}
+		}
+	}
+
+	/**
+	 * @brief Seal the given chunk and pass it to the host; it's moved to
+	 *        the cold tier only if it's still the oldest chunk in the hot
+	 *        tier, otherwise the copy at the host is removed
+	 *
+	 * @return false if the chunk can't be passed to the host
+	 */
+	bool Spill(uint64_t chunkIdx, std::shared_ptr<const PastEventChunk> chunk)
+	{
+		uint64_t key = 0;
+		try
+		{
+			key = m_spill.m_store->Store(chunk->Serialize());
+		}
+		catch (const std::exception& e)
+		{
+			m_logger.Error(
+				std::string("Failed to spill past events: ") + e.what()
+			);
+			return false;
+		}
+
+		bool isSpilled = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (chunkIdx == m_firstChunkIdx + m_numColdChunks)
+			{
+				ChunkSlot& slot = m_chunks[m_numColdChunks];
+				slot.m_spillKey = key;
+				// snapshots holding the chunk can still share it
+				slot.m_pagedChunk = slot.m_hotChunk;
+				slot.m_hotChunk.reset();
+				++m_numColdChunks;
+				++m_stats.m_numSpilledChunks;
+				isSpilled = true;
+			}
+		}
+
+		if (!isSpilled)
+		{
+			RemoveSpilled(key);
+		}
+		return true;
+	}
+
+	std::shared_ptr<const PastEventChunk> PageIn(uint64_t key) const
+	{
+		std::shared_ptr<const PastEventChunk> chunk =
+			PastEventChunk::Deserialize(m_spill.m_store->Load(key));
+		if (!chunk->IsFull())
+		{
+			// only full chunks are spilled
+			throw std::runtime_error("Spilled past event chunk is truncated");
+		}
+		return chunk;
+	}
+
+	void RemoveSpilled(uint64_t key)
+	{
+		try
+		{
+			m_spill.m_store->Remove(key);
+		}
+		catch (const std::exception& e)
+		{
+			// the host only wastes some disk space
+			m_logger.Error(
+				std::string("Failed to remove spilled past events: ") +
+				e.what()
+			);
+		}
+	}
+
+private:
+
+	DecentEnclave::Common::Logger m_logger;
+	EventRetention m_retention;
+	EventSpill m_spill;
+	mutable std::mutex m_mutex;
+	std::deque<ChunkSlot> m_chunks;
+	size_t m_offset;
+	size_t m_numEvents;
+	uint64_t m_firstSeq;
+	/**
+	 * @brief The index of the first chunk, counted from the first chunk
+	 *        ever created
+	 *
+	 */
+	uint64_t m_firstChunkIdx;
+	/**
+	 * @brief The number of spilled chunks, which are always the oldest ones
+	 *
+	 */
+	size_t m_numColdChunks;
+	/**
+	 * @brief The block number of the last evicted event, if it's known,
+	 *        i.e., if any event has been evicted since the log is created
+	 *
+	 */
+	uint64_t m_lastEvictedBlkNum;
+	bool m_isLastEvictedKnown;
+	/**
+	 * @brief Whether a spilling task of this log is scheduled or running
+	 *
+	 */
+	bool m_isSpilling;
+	PastEventStats m_stats;
+}; // class PastEventLog
+
+
+/**
+ * @brief A cursor of a subscriber into a shared past event log, which
+ *        only remembers the sequence number of the next event to be
+ *        delivered
+ *
+ */
+class PastEventCursor
+{
+public:
+
+	PastEventCursor(
+		std::shared_ptr<const PastEventLog> evLog,
+		uint64_t nextSeq
+	) :
+		m_evLog(std::move(evLog)),
+		m_nextSeq(nextSeq),
+		m_numMissed(0)
+	{}
+
+	~PastEventCursor() = default;
+
+	/**
+	 * @brief Get the events appended since the last call, and move the
+	 *        cursor past them
+	 *
+	 */
+	PastEventSnapshot Next()
+	{
+		PastEventSnapshot snapshot = m_evLog->GetSnapshot(m_nextSeq);
+
+		if (snapshot.GetBeginSeq() > m_nextSeq)
+		{
+			// these events were evicted before being delivered
+			m_numMissed += snapshot.GetBeginSeq() - m_nextSeq;
+		}
+		m_nextSeq = snapshot.GetEndSeq();
+
+		return snapshot;
+	}
+
+	uint64_t GetNumMissed() const
+	{
+		return m_numMissed;
+	}
+
+private:
+
+	std::shared_ptr<const PastEventLog> m_evLog;
+	uint64_t m_nextSeq;
+	uint64_t m_numMissed;
+}; // class PastEventCursor
+
+
+} // namespace Pubsub
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -6,6 +6,8 @@
 #pragma once
 
 
+#include <unordered_set>
+
 #include <AdvancedRlp/AdvancedRlp.hpp>
 
 #include <DecentEnclave/Common/Logging.hpp>
@@ -16,6 +18,8 @@
 
 #include "../BlockchainMgr.hpp"
 #include "../DataType.hpp"
+#include "../OutboundQueue.hpp"
+#include "../SubscriptionLifecycle.hpp"
 #include "SubscriberService.hpp"
 
 
@@ -28,136 +32,537 @@ namespace Pubsub
 {
 
 
-inline void NotifyEventHandler(
-	ThreadedEventQueue& evQueue,
-	DecentEnclave::Common::Logger& logger,
-	const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-	const EclipseMonitor::Eth::ReceiptLogEntry& log
+/**
+ * @brief The versions of the protocol used to emit messages to subscribers;
+ *        it's requested by the subscriber in the subscribe request
+ *        - Full: every message carries the secure state, the latest block
+ *          number, and the events since the last message
+ *        - Compact: the first message is the same as in the full protocol,
+ *          plus the protocol version; after that, messages only carry
+ *          the secure state if it has changed, the increase of the latest
+ *          block number, and the events if there are any; a message with
+ *          nothing but the block number increase is sent as a Bytes object
+ *          rather than a Dict, so it's only a few bytes long
+ *        If the subscriber asks for resumable delivery (see SubReq), or
+ *        uses the compact protocol, messages that carry events also carry
+ *        the sequence number of the next event of each event manager
+ *        followed ("NextSeqs"), which the subscriber can resume from after
+ *        reconnecting; otherwise, the messages are the same as before the
+ *        sequence numbers were introduced
+ *        If some of the events the subscriber resumes from have been
+ *        evicted, the first message also carries, for each event manager,
+ *        the sequence number of the first event actually sent
+ *        ("BeginSeqs"), and whether any event was missed ("Gaps")
+ *
+ */
+enum class EmitProtocol : uint8_t
+{
+	Full    = 1,
+	Compact = 2,
+}; // enum class EmitProtocol
+
+
+/**
+ * @brief The sequence numbers of the next events of the event managers
+ *        followed by a subscriber, in the order they are subscribed
+ *
+ */
+using EventSeqList = SimpleObjects::ListT<SimpleObjects::Bytes>;
+
+
+/**
+ * @brief Get the format of the messages of a subscription, which tells
+ *        apart the cached messages built for different subscriptions
+ *
+ * @param withSeqs Whether the messages carry the sequence numbers
+ */
+inline uint8_t GetEmitFormat(EmitProtocol protocol, bool withSeqs)
+{
+	static constexpr uint8_t sk_withSeqsFlag = 0x80;
+
+	return static_cast<uint8_t>(protocol) | (withSeqs ? sk_withSeqsFlag : 0);
+}
+
+
+/**
+ * @brief The events missed by a resumed subscription, which are evicted
+ *        before the subscription is made; one entry for each event manager
+ *        followed, in the order they are subscribed
+ *
+ */
+struct MissedEvents
+{
+	MissedEvents() :
+		m_beginSeqs(),
+		m_gaps(),
+		m_hasGap(false)
+	{}
+
+	// the sequence numbers of the first events sent
+	EventSeqList                               m_beginSeqs;
+	// 1 if any event was missed, otherwise 0
+	SimpleObjects::ListT<SimpleObjects::Bytes> m_gaps;
+	bool                                       m_hasGap;
+}; // struct MissedEvents
+
+
+inline std::vector<uint8_t> BuildEmittedMsg(
+	const SimpleObjects::Bytes& secState,
+	SimpleObjects::Bytes&& latestBlkNum,
+	EventDataQueue&& evQueue,
+	EventSeqList&& nextSeqs,
+	EmitProtocol protocol = EmitProtocol::Full,
+	bool withSeqs = false,
+	const MissedEvents* missed = nullptr
+)
+{
+	static const SimpleObjects::String sk_labelSecState("SecState");
+	static const SimpleObjects::String sk_labelLatestBlkNum("LatestBlkNum");
+	static const SimpleObjects::String sk_labelEvents("Events");
+	static const SimpleObjects::String sk_labelNextSeqs("NextSeqs");
+	static const SimpleObjects::String sk_labelProtocol("Protocol");
+	static const SimpleObjects::String sk_labelBeginSeqs("BeginSeqs");
+	static const SimpleObjects::String sk_labelGaps("Gaps");
+
+	SimpleObjects::Dict respDict;
+	respDict[sk_labelSecState] = secState;
+	respDict[sk_labelLatestBlkNum] = std::move(latestBlkNum);
+	respDict[sk_labelEvents] = std::move(evQueue);
+	if (withSeqs)
+	{
+		respDict[sk_labelNextSeqs] = std::move(nextSeqs);
+	}
+	if (protocol != EmitProtocol::Full)
+	{
+		// acknowledge the protocol requested by the subscriber
+		respDict[sk_labelProtocol] = SimpleObjects::Bytes({
+			static_cast<uint8_t>(protocol),
+		});
+	}
+	if ((missed != nullptr) && missed->m_hasGap)
+	{
+		respDict[sk_labelBeginSeqs] = missed->m_beginSeqs;
+		respDict[sk_labelGaps] = missed->m_gaps;
+	}
+	std::vector<uint8_t> respMsg =
+		AdvancedRlp::GenericWriter::Write(respDict);
+
+	return respMsg;
+}
+
+
+/**
+ * @brief Build a message of the compact protocol
+ *
+ * @param secState    The secure state, or nullptr if it hasn't changed
+ * @param blkNumDelta The increase of the latest block number
+ * @param evQueue     The events since the last message
+ * @param nextSeqs    The sequence numbers of the next events; only sent
+ *                    along with events
+ */
+inline std::vector<uint8_t> BuildCompactEmittedMsg(
+	const SimpleObjects::Bytes* secState,
+	uint64_t blkNumDelta,
+	EventDataQueue&& evQueue,
+	EventSeqList&& nextSeqs
 )
 {
-	// 1. Extract event message from log data
-	std::vector<uint8_t> evMsg;
+	static const SimpleObjects::String sk_labelSecState("SecState");
+	static const SimpleObjects::String sk_labelBlkNumDelta("BlkNumDelta");
+	static const SimpleObjects::String sk_labelEvents("Events");
+	static const SimpleObjects::String sk_labelNextSeqs("NextSeqs");
+
+	if ((secState == nullptr) && (evQueue.size() == 0))
+	{
+		// keepalive
+		return AdvancedRlp::GenericWriter::Write(BlkNumToBytes(blkNumDelta));
+	}
+
+	SimpleObjects::Dict respDict;
+	if (secState != nullptr)
+	{
+		respDict[sk_labelSecState] = *secState;
+	}
+	respDict[sk_labelBlkNumDelta] = BlkNumToBytes(blkNumDelta);
+	if (evQueue.size() != 0)
+	{
+		respDict[sk_labelEvents] = std::move(evQueue);
+		respDict[sk_labelNextSeqs] = std::move(nextSeqs);
+	}
+	std::vector<uint8_t> respMsg =
+		AdvancedRlp::GenericWriter::Write(respDict);
 
-	using _MsgParser =
-		EclipseMonitor::Eth::AbiParser<
-			SimpleObjects::ObjCategory::Bytes,
-			std::true_type
-		>;
-	auto abiBegin = log.m_logData.begin();
-	auto abiEnd = log.m_logData.end();
+	return respMsg;
+}
 
-	std::tie(evMsg, abiBegin) =
-		_MsgParser().ToPrimitive(abiBegin, abiEnd, abiBegin);
 
-	// 2. Save event to event queue
+/**
+ * @brief An event manager followed by a subscription
+ *
+ */
+struct EventSource
+{
+	EventSource(SimpleObjects::Bytes evMgrId, PastEventCursor evCursor) :
+		m_evMgrId(std::move(evMgrId)),
+		m_evCursor(std::move(evCursor))
+	{}
+
+	// the address of the event manager; it tags the events of this
+	// manager in a multiplexed subscription
+	SimpleObjects::Bytes m_evMgrId;
+	PastEventCursor      m_evCursor;
+}; // struct EventSource
+
+
+/**
+ * @brief The state of a subscriber of one or more event managers
+ *
+ */
+template<typename _NetConfig>
+struct Subscription
+{
+	using MonitorSnapshotPtr =
+		typename BlockchainMgr<_NetConfig>::MonitorSnapshotPtr;
+
+	Subscription(
+		std::shared_ptr<OutboundQueue> outQueue,
+		EmitProtocol protocol,
+		bool withSeqs,
+		bool isMultiplexed,
+		std::vector<EventSource> sources,
+		std::shared_ptr<EmittedFrameCache> frameCache,
+		MonitorSnapshotPtr lastSnapshot
+	) :
+		m_outQueue(std::move(outQueue)),
+		m_protocol(protocol),
+		m_withSeqs(withSeqs),
+		m_isMultiplexed(isMultiplexed),
+		m_sources(std::move(sources)),
+		m_frameCache(std::move(frameCache)),
+		m_lastSnapshot(std::move(lastSnapshot)),
+		m_mutex()
+	{}
+
+	std::shared_ptr<OutboundQueue>     m_outQueue;
+	EmitProtocol                       m_protocol;
+	// if the messages carry the sequence numbers of the next events
+	bool                               m_withSeqs;
+	// if the events are tagged with their event managers
+	bool                               m_isMultiplexed;
+	std::vector<EventSource>           m_sources;
+	// the frame cache shared with the other subscriptions following the
+	// same event manager, or the same list of event managers
+	std::shared_ptr<EmittedFrameCache> m_frameCache;
+	// the state of the monitor sent in the last message
+	MonitorSnapshotPtr                 m_lastSnapshot;
+	// emitted by both the heartbeat and the push tick
+	std::mutex                         m_mutex;
+}; // struct Subscription
+
+
+/**
+ * @brief Build the message that carries the given events and the given
+ *        state of the monitor
+ *
+ * @param withSeqs Whether the message carries the sequence numbers; they
+ *                 are always carried by the compact protocol
+ * @param last     The state of the monitor sent in the last message;
+ *                 nullptr for the first message
+ * @param missed   The events missed by a resumed subscription; only given
+ *                 for the first message
+ */
+template<typename _NetConfig>
+inline std::vector<uint8_t> BuildEmittedFrame(
+	EmitProtocol protocol,
+	bool withSeqs,
+	const typename BlockchainMgr<_NetConfig>::MonitorSnapshot* last,
+	const typename BlockchainMgr<_NetConfig>::MonitorSnapshot& curr,
+	EventDataQueue&& evQueue,
+	EventSeqList&& nextSeqs,
+	const MissedEvents* missed = nullptr
+)
+{
+	if ((protocol == EmitProtocol::Full) || (last == nullptr))
 	{
-		std::lock_guard<std::mutex> lock(evQueue.m_mutex);
-		evQueue.m_eventQueue.push_back(
-			EventData({
-				EventData::value_type(headerMgr.GetRawHeader().get_Number()),
-				EventData::value_type(evMsg),
-			})
+		return BuildEmittedMsg(
+			*(curr.m_secStateRlp),
+			SimpleObjects::Bytes(curr.m_lastValidatedBlkNum),
+			std::move(evQueue),
+			std::move(nextSeqs),
+			protocol,
+			withSeqs,
+			missed
 		);
 	}
 
-	// 3. Debug message
-	logger.Debug(
-		"Emit an event at block #" + std::to_string(headerMgr.GetNumber())
+	const uint64_t lastBlkNum = BlkNumFromBytes(last->m_lastValidatedBlkNum);
+	const uint64_t currBlkNum = BlkNumFromBytes(curr.m_lastValidatedBlkNum);
+
+	return BuildCompactEmittedMsg(
+		(last->m_secStateRlp != curr.m_secStateRlp) ?
+			curr.m_secStateRlp.get() :
+			nullptr,
+		(currBlkNum > lastBlkNum) ? (currBlkNum - lastBlkNum) : 0,
+		std::move(evQueue),
+		std::move(nextSeqs)
 	);
 }
 
 
-inline EclipseMonitor::Eth::EventDescription
-BuildNotifyEventDescr(
-	const EclipseMonitor::Eth::ContractAddr& evMgrContAddr,
-	EclipseMonitor::Eth::EventTopic notifyEvTopic,
-	std::shared_ptr<ThreadedEventQueue> eventQueue
+/**
+ * @brief Get the message that carries the given events and the given state
+ *        of the monitor; it's only built and encoded by the first
+ *        subscriber that needs it, and the others get the same buffer
+ *
+ * @param lastSnapshot The state of the monitor sent in the last message;
+ *                     nullptr for the first message
+ */
+template<typename _NetConfig>
+inline EmittedFrameCache::FramePtr GetEmittedFrame(
+	EmittedFrameCache& frameCache,
+	EmitProtocol protocol,
+	bool withSeqs,
+	typename BlockchainMgr<_NetConfig>::MonitorSnapshotPtr lastSnapshot,
+	typename BlockchainMgr<_NetConfig>::MonitorSnapshotPtr currSnapshot,
+	const PastEventSnapshot& events
 )
 {
-	std::shared_ptr<DecentEnclave::Common::Logger> logger =
-		std::make_shared<DecentEnclave::Common::Logger>(
-			DecentEnclave::Common::LoggerFactory::GetLogger(
-				std::string("Event Manager @") +
-					SimpleObjects::Codec::Hex::
-						Encode<std::string>(evMgrContAddr)
-			)
-		);
+	// full messages don't depend on the last state
+	if (protocol == EmitProtocol::Full)
+	{
+		lastSnapshot.reset();
+	}
+
+	const auto* last = lastSnapshot.get();
+	const auto& curr = *currSnapshot;
 
-	EclipseMonitor::Eth::EventDescription eventDesc(
-		evMgrContAddr,
-		std::vector<EclipseMonitor::Eth::EventTopic>({
-			notifyEvTopic,
-		}),
-		[eventQueue, logger](
-			const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-			const EclipseMonitor::Eth::ReceiptLogEntry& log,
-			EclipseMonitor::Eth::EventCallbackId
-		) -> void
+	return frameCache.GetOrBuild(
+		GetEmitFormat(protocol, withSeqs),
+		std::move(lastSnapshot),
+		std::move(currSnapshot),
+		events.GetBeginSeq(),
+		events.GetEndSeq(),
+		[last, &curr, &events, protocol, withSeqs]()
 		{
-			NotifyEventHandler(*eventQueue, *logger, headerMgr, log);
+			return BuildEmittedFrame<_NetConfig>(
+				protocol,
+				withSeqs,
+				last,
+				curr,
+				events.ToEventDataQueue(),
+				EventSeqList({ BlkNumToBytes(events.GetEndSeq()) })
+			);
 		}
 	);
+}
 
-	return eventDesc;
+
+/**
+ * @brief Append the given events to the queue, each tagged with the
+ *        address of its event manager, i.e., in the form of
+ *        [block number, message, event manager address]
+ *
+ */
+inline void AppendTaggedEvents(
+	EventDataQueue& evQueue,
+	const PastEventSnapshot& events,
+	const SimpleObjects::Bytes& evMgrId
+)
+{
+	events.ForEach(
+		[&evQueue, &evMgrId](const PastEventChunk& chunk, size_t idx)
+		{
+			EventData evData = chunk.ToEventData(idx);
+			evData.push_back(evMgrId);
+			evQueue.push_back(std::move(evData));
+		}
+	);
 }
 
 
-inline std::vector<uint8_t> BuildEmittedMsg(
-	SimpleObjects::Bytes&& secState,
-	SimpleObjects::Bytes&& latestBlkNum,
-	EventDataQueue&& evQueue
+/**
+ * @brief Get the message of a multiplexed subscription that carries the
+ *        given events of each source and the given state of the monitor;
+ *        like GetEmittedFrame, it's shared by the subscriptions following
+ *        the same sources from the same positions
+ *
+ * @param lastSnapshot The state of the monitor sent in the last message;
+ *                     nullptr for the first message
+ * @param events       The events of each source, in the order of sources
+ */
+template<typename _NetConfig>
+inline EmittedFrameCache::FramePtr GetMuxEmittedFrame(
+	EmittedFrameCache& frameCache,
+	EmitProtocol protocol,
+	bool withSeqs,
+	typename BlockchainMgr<_NetConfig>::MonitorSnapshotPtr lastSnapshot,
+	typename BlockchainMgr<_NetConfig>::MonitorSnapshotPtr currSnapshot,
+	const std::vector<EventSource>& sources,
+	const std::vector<PastEventSnapshot>& events
 )
 {
-	static const SimpleObjects::String sk_labelSecState("SecState");
-	static const SimpleObjects::String sk_labelLatestBlkNum("LatestBlkNum");
-	static const SimpleObjects::String sk_labelEvents("Events");
+	// full messages don't depend on the last state
+	if (protocol == EmitProtocol::Full)
+	{
+		lastSnapshot.reset();
+	}
 
-	SimpleObjects::Dict respDict;
-	respDict[sk_labelSecState] = std::move(secState);
-	respDict[sk_labelLatestBlkNum] = std::move(latestBlkNum);
-	respDict[sk_labelEvents] = std::move(evQueue);
-	std::vector<uint8_t> respMsg =
-		AdvancedRlp::GenericWriter::Write(respDict);
+	const auto* last = lastSnapshot.get();
+	const auto& curr = *currSnapshot;
 
-	return respMsg;
+	EmittedFrameCache::SeqList beginSeqs;
+	EmittedFrameCache::SeqList endSeqs;
+	beginSeqs.reserve(events.size());
+	endSeqs.reserve(events.size());
+	for (const auto& sourceEvents : events)
+	{
+		beginSeqs.push_back(sourceEvents.GetBeginSeq());
+		endSeqs.push_back(sourceEvents.GetEndSeq());
+	}
+
+	return frameCache.GetOrBuild(
+		GetEmitFormat(protocol, withSeqs),
+		std::move(lastSnapshot),
+		std::move(currSnapshot),
+		std::move(beginSeqs),
+		std::move(endSeqs),
+		[last, &curr, &sources, &events, protocol, withSeqs]()
+		{
+			EventDataQueue evQueue;
+			EventSeqList nextSeqs;
+			for (size_t i = 0; i < events.size(); ++i)
+			{
+				AppendTaggedEvents(evQueue, events[i], sources[i].m_evMgrId);
+				nextSeqs.push_back(BlkNumToBytes(events[i].GetEndSeq()));
+			}
+			return BuildEmittedFrame<_NetConfig>(
+				protocol,
+				withSeqs,
+				last,
+				curr,
+				std::move(evQueue),
+				std::move(nextSeqs)
+			);
+		}
+	);
+}
+
+
+/**
+ * @brief Get the events of the given source that haven't been sent yet
+ *
+ */
+inline PastEventSnapshot NextEvents(
+	EventSource& source,
+	DecentEnclave::Common::Logger& logger
+)
+{
+	const uint64_t numMissedBefore = source.m_evCursor.GetNumMissed();
+	PastEventSnapshot newEvents = source.m_evCursor.Next();
+	const uint64_t numMissed =
+		source.m_evCursor.GetNumMissed() - numMissedBefore;
+	if (numMissed != 0)
+	{
+		logger.Error(
+			std::to_string(numMissed) +
+			" events were evicted before being sent to a subscriber"
+		);
+	}
+	return newEvents;
 }
 
 
 template<typename _NetConfig>
 inline void EmitterHandler(
-	LambdaMsgSocket& socket,
-	ThreadedEventQueue& evQueue,
-	BlockchainMgr<_NetConfig>& bcMgr,
-	EclipseMonitor::Eth::EventCallbackId listenId
+	Subscription<_NetConfig>& sub,
+	BlockchainMgr<_NetConfig>& bcMgr
 )
 {
+	using namespace DecentEnclave::Common;
+
+	static Logger s_logger =
+		LoggerFactory::GetLogger("DecentEthereum::Trusted::PubSub::Emitter");
+
+	std::lock_guard<std::mutex> lock(sub.m_mutex);
+
 	try
 	{
-		EventDataQueue outEvQueue;
+		if (!sub.m_outQueue->HasRoom())
 		{
-			std::lock_guard<std::mutex> lock(evQueue.m_mutex);
-			outEvQueue = std::move(evQueue.m_eventQueue);
-			evQueue.m_eventQueue = EventDataQueue();
+			// the cursors are not moved, so the events will be sent in a
+			// later heartbeat
+			s_logger.Debug("Outbound queue is full; heartbeat dropped");
+			return;
 		}
 
-		std::vector<uint8_t> respMsg = BuildEmittedMsg(
-			SimpleObjects::Bytes(AdvancedRlp::GenericWriter::Write(
-				bcMgr.GetMonitorSecState()
-			)),
-			bcMgr.GetLastValidatedBlkNum(),
-			std::move(outEvQueue)
-		);
+		auto currSnapshot = bcMgr.GetMonitorSnapshot();
+		EmittedFrameCache::FramePtr frame;
+		if (!sub.m_isMultiplexed)
+		{
+			PastEventSnapshot newEvents =
+				NextEvents(sub.m_sources.front(), s_logger);
+			frame = GetEmittedFrame<_NetConfig>(
+				*sub.m_frameCache,
+				sub.m_protocol,
+				sub.m_withSeqs,
+				sub.m_lastSnapshot,
+				currSnapshot,
+				newEvents
+			);
+		}
+		else
+		{
+			std::vector<PastEventSnapshot> newEvents;
+			newEvents.reserve(sub.m_sources.size());
+			for (auto& source : sub.m_sources)
+			{
+				newEvents.push_back(NextEvents(source, s_logger));
+			}
+			frame = GetMuxEmittedFrame<_NetConfig>(
+				*sub.m_frameCache,
+				sub.m_protocol,
+				sub.m_withSeqs,
+				sub.m_lastSnapshot,
+				currSnapshot,
+				sub.m_sources,
+				newEvents
+			);
+		}
+		sub.m_lastSnapshot = std::move(currSnapshot);
 
-		socket.SizedSendBytes(respMsg);
+		sub.m_outQueue->Push(std::move(frame));
 	}
 	catch(const std::exception&)
 	{
-		bcMgr.GetEventManager().Cancel(listenId);
+		// tear down the subscription
+		sub.m_outQueue->Close();
 		throw;
 	}
 }
 
 
+/**
+ * @brief Handle a subscribe request, which is a Dict of
+ *        - "publisher": the address of the publisher to follow; or
+ *        - "publishers": a list of addresses of the publishers to follow,
+ *          which are multiplexed into one stream, where each event is
+ *          tagged with the address of its event manager
+ *        - "protocol" (optional): the version of the protocol, see
+ *          EmitProtocol
+ *        - "resumable" (optional): non-zero to receive the sequence
+ *          numbers of the next events ("NextSeqs") with the full protocol;
+ *          it's implied by the compact protocol, fromSeq, and fromBlock
+ *        - "fromSeq" (optional): the sequence number of the first event to
+ *          send, i.e., the "NextSeqs" received last time, to resume from
+ *          after reconnecting; a list, in the order of "publishers", for a
+ *          multiplexed subscription
+ *        - "fromBlock" (optional): the number of the first block whose
+ *          events are sent
+ *        By default, all the retained past events are sent; if some of
+ *        the events since fromSeq or fromBlock have been evicted, the
+ *        first message tells which ones (see EmitProtocol)
+ *
+ */
 template<typename _NetConfig>
 inline void SubReq(
 	std::shared_ptr<BlockchainMgr<_NetConfig> > bcMgrPtr,
@@ -174,56 +579,312 @@ inline void SubReq(
 	static Logger s_logger =
 		LoggerFactory::GetLogger("DecentEthereum::Trusted::PubSub::SubReq");
 	static const SimpleObjects::String sk_labelPublisher("publisher");
+	static const SimpleObjects::String sk_labelPublishers("publishers");
+	static const SimpleObjects::String sk_labelProtocol("protocol");
+	static const SimpleObjects::String sk_labelResumable("resumable");
+	static const SimpleObjects::String sk_labelFromSeq("fromSeq");
+	static const SimpleObjects::String sk_labelFromBlock("fromBlock");
+
+	// max number of publishers followed by a multiplexed subscription
+	static constexpr size_t sk_maxPublishers = 1024;
+
+	const SubscriberService& subSvc = bcMgrPtr->GetSubscriberService();
 
-	// 1. lookup for the on-chain event manager address
+	// 1. lookup for the on-chain event manager addresses
 	auto msgContent = AdvancedRlp::Parse(msgContentAdvRlp);
 	const auto& msgContentDict = msgContent.AsDict();
-	const auto& pubAddrObjBase = msgContentDict[sk_labelPublisher].AsBytes();
-	SimpleObjects::Bytes pubAddr(pubAddrObjBase.begin(), pubAddrObjBase.end());
 
-	auto eventMgrAddr =
-		bcMgrPtr->GetSubscriberService().GetEventMgrAddr(pubAddr);
+	std::vector<SimpleObjects::Bytes> pubAddrs;
+	const bool isMultiplexed = msgContentDict.HasKey(sk_labelPublishers);
+	if (isMultiplexed)
+	{
+		const auto& pubAddrList = msgContentDict[sk_labelPublishers].AsList();
+		if ((pubAddrList.size() == 0) || (pubAddrList.size() > sk_maxPublishers))
+		{
+			s_logger.Error(
+				"Invalid number of publishers " +
+				std::to_string(pubAddrList.size())
+			);
+			return;
+		}
+		for (const auto& pubAddrObj : pubAddrList)
+		{
+			const auto& pubAddrObjBase = pubAddrObj.AsBytes();
+			pubAddrs.emplace_back(pubAddrObjBase.begin(), pubAddrObjBase.end());
+		}
+	}
+	else
+	{
+		const auto& pubAddrObjBase =
+			msgContentDict[sk_labelPublisher].AsBytes();
+		pubAddrs.emplace_back(pubAddrObjBase.begin(), pubAddrObjBase.end());
+	}
+
+	// the protocol is optional, and it's the full protocol by default
+	EmitProtocol protocol = EmitProtocol::Full;
+	if (msgContentDict.HasKey(sk_labelProtocol))
+	{
+		const uint64_t protocolVer =
+			msgContentDict[sk_labelProtocol].AsCppUInt64();
+		if (protocolVer == static_cast<uint64_t>(EmitProtocol::Compact))
+		{
+			protocol = EmitProtocol::Compact;
+		}
+		else if (protocolVer != static_cast<uint64_t>(EmitProtocol::Full))
+		{
+			s_logger.Error(
+				"Unsupported protocol version " + std::to_string(protocolVer)
+			);
+			return;
+		}
+	}
+
+	// where to resume from
+	const bool hasFromSeq = msgContentDict.HasKey(sk_labelFromSeq);
+	const bool hasFromBlock = msgContentDict.HasKey(sk_labelFromBlock);
+	if (hasFromSeq && hasFromBlock)
+	{
+		s_logger.Error("Only one of fromSeq and fromBlock can be given");
+		return;
+	}
+	// the sequence numbers are only sent to subscribers asking for them,
+	// so the messages to the others stay the same
+	const bool withSeqs =
+		(protocol != EmitProtocol::Full) ||
+		hasFromSeq ||
+		hasFromBlock ||
+		(
+			msgContentDict.HasKey(sk_labelResumable) &&
+			(msgContentDict[sk_labelResumable].AsCppUInt64() != 0)
+		);
+	const uint64_t fromBlock = hasFromBlock ?
+		msgContentDict[sk_labelFromBlock].AsCppUInt64() :
+		0;
+	std::vector<uint64_t> fromSeqs(pubAddrs.size(), 0);
+	if (hasFromSeq && isMultiplexed)
+	{
+		const auto& fromSeqList = msgContentDict[sk_labelFromSeq].AsList();
+		if (fromSeqList.size() != pubAddrs.size())
+		{
+			s_logger.Error("The numbers of fromSeq and publishers mismatch");
+			return;
+		}
+		for (size_t i = 0; i < fromSeqList.size(); ++i)
+		{
+			fromSeqs[i] = fromSeqList[i].AsCppUInt64();
+		}
+	}
+	else if (hasFromSeq)
+	{
+		fromSeqs[0] = msgContentDict[sk_labelFromSeq].AsCppUInt64();
+	}
+
+	std::vector<EclipseMonitor::Eth::ContractAddr> eventMgrAddrs;
+	std::vector<std::shared_ptr<const PastEventLog> > evLogs;
+	std::unordered_set<SimpleObjects::Bytes> evMgrIds;
+	for (const auto& pubAddr : pubAddrs)
+	{
+		auto eventMgrAddr = subSvc.GetEventMgrAddr(pubAddr);
+		if (eventMgrAddr == EclipseMonitor::Eth::ContractAddr())
+		{
+			s_logger.Error(
+				"Failed to find the event manager for publisher @" +
+					SimpleObjects::Codec::Hex::Encode<std::string>(pubAddr)
+			);
+			return;
+		}
+
+		if (!evMgrIds.emplace(eventMgrAddr.begin(), eventMgrAddr.end()).second)
+		{
+			// otherwise, the events would be sent more than once
+			s_logger.Error(
+				"Publisher @" +
+					SimpleObjects::Codec::Hex::Encode<std::string>(pubAddr) +
+					" is listed more than once"
+			);
+			return;
+		}
+
+		// 2. subscribe to the shared event log of the event manager
+		s_logger.Debug("Subscribing to event manager @" +
+			SimpleObjects::Codec::Hex::Encode<std::string>(eventMgrAddr)
+		);
+		std::shared_ptr<const PastEventLog> evLog =
+			subSvc.GetPastEventLog(eventMgrAddr);
+		if (evLog == nullptr)
+		{
+			s_logger.Error(
+				"Failed to find the event log of event manager @" +
+					SimpleObjects::Codec::Hex::Encode<std::string>(eventMgrAddr)
+			);
+			return;
+		}
 
-	if (eventMgrAddr == EclipseMonitor::Eth::ContractAddr())
+		if (hasFromBlock)
+		{
+			fromSeqs[evLogs.size()] = evLog->FindSeqByBlkNum(fromBlock);
+		}
+
+		eventMgrAddrs.push_back(eventMgrAddr);
+		evLogs.push_back(std::move(evLog));
+	}
+
+	// 3. respond with the current state, and the past events since where
+	//    the subscriber resumes from (if they are still retained)
+	//    the cursors start right after the past events sent here, so no
+	//    event is missed or sent twice
+	auto currSnapshot = bcMgrPtr->GetMonitorSnapshot();
+
+	std::vector<EventSource> sources;
+	std::vector<PastEventSnapshot> pastEvents;
+	MissedEvents missed;
+	sources.reserve(evLogs.size());
+	pastEvents.reserve(evLogs.size());
+	for (size_t i = 0; i < evLogs.size(); ++i)
+	{
+		pastEvents.push_back(evLogs[i]->GetSnapshot(fromSeqs[i]));
+		const uint64_t beginSeq = pastEvents.back().GetBeginSeq();
+		sources.emplace_back(
+			SimpleObjects::Bytes(
+				eventMgrAddrs[i].begin(),
+				eventMgrAddrs[i].end()
+			),
+			PastEventCursor(evLogs[i], pastEvents.back().GetEndSeq())
+		);
+
+		// the snapshot silently starts from the oldest retained event, so
+		// the subscriber is told if anything it asked for is gone
+		const bool isGap =
+			(hasFromSeq || hasFromBlock) &&
+			(
+				(beginSeq > fromSeqs[i]) ||
+				(hasFromBlock && evLogs[i]->IsEvictedSince(fromBlock))
+			);
+		missed.m_beginSeqs.push_back(BlkNumToBytes(beginSeq));
+		missed.m_gaps.push_back(SimpleObjects::Bytes({
+			static_cast<uint8_t>(isGap ? 1 : 0),
+		}));
+		missed.m_hasGap = missed.m_hasGap || isGap;
+	}
+
+	std::shared_ptr<EmittedFrameCache> frameCache = isMultiplexed ?
+		subSvc.GetEmittedFrameCache(eventMgrAddrs) :
+		subSvc.GetEmittedFrameCache(eventMgrAddrs.front());
+	EmittedFrameCache::FramePtr frame;
+	if (missed.m_hasGap)
 	{
 		s_logger.Error(
-			"Failed to find the event manager for publisher @" +
-				SimpleObjects::Codec::Hex::Encode<std::string>(pubAddr)
+			"Some of the events to resume from have been evicted"
+		);
+
+		// the message is specific to this subscriber, so it's not cached
+		EventDataQueue pastEvQueue;
+		EventSeqList nextSeqs;
+		for (size_t i = 0; i < pastEvents.size(); ++i)
+		{
+			if (isMultiplexed)
+			{
+				AppendTaggedEvents(
+					pastEvQueue,
+					pastEvents[i],
+					sources[i].m_evMgrId
+				);
+			}
+			else
+			{
+				pastEvQueue = pastEvents[i].ToEventDataQueue();
+			}
+			nextSeqs.push_back(BlkNumToBytes(pastEvents[i].GetEndSeq()));
+		}
+		frame = std::make_shared<const EmittedFrameCache::Frame>(
+			BuildEmittedFrame<_NetConfig>(
+				protocol,
+				withSeqs,
+				nullptr,
+				*currSnapshot,
+				std::move(pastEvQueue),
+				std::move(nextSeqs),
+				&missed
+			)
+		);
+	}
+	else if (!isMultiplexed)
+	{
+		frame = GetEmittedFrame<_NetConfig>(
+			*frameCache,
+			protocol,
+			withSeqs,
+			nullptr,
+			currSnapshot,
+			pastEvents.front()
+		);
+	}
+	else
+	{
+		frame = GetMuxEmittedFrame<_NetConfig>(
+			*frameCache,
+			protocol,
+			withSeqs,
+			nullptr,
+			currSnapshot,
+			sources,
+			pastEvents
 		);
-		return;
 	}
+	socket->SizedSendBytes(*frame);
 
-	// 2. subscribe to event manager first
-	s_logger.Debug("Subscribing to event manager @" +
-		SimpleObjects::Codec::Hex::Encode<std::string>(eventMgrAddr)
-	);
-	std::shared_ptr<ThreadedEventQueue> eventQueue =
-		std::make_shared<ThreadedEventQueue>();
-	auto listenId = bcMgrPtr->GetEventManager().Listen(
-		BuildNotifyEventDescr(
-			eventMgrAddr,
-			bcMgrPtr->GetSubscriberService().GetNotifyEventTopic(),
-			eventQueue
-		)
-	);
+	// 4. set up heartbeat emitter
+	std::shared_ptr<OutboundQueue> outQueue =
+		std::make_shared<OutboundQueue>(std::move(socket));
+	std::shared_ptr<Subscription<_NetConfig> > sub =
+		std::make_shared<Subscription<_NetConfig> >(
+			outQueue,
+			protocol,
+			withSeqs,
+			isMultiplexed,
+			std::move(sources),
+			frameCache,
+			currSnapshot
+		);
 
-	// 3. respond with the current state
-	std::vector<uint8_t> respMsg = BuildEmittedMsg(
-		SimpleObjects::Bytes(AdvancedRlp::GenericWriter::Write(
-			bcMgrPtr->GetMonitorSecState()
-		)),
-		bcMgrPtr->GetLastValidatedBlkNum(),
-		bcMgrPtr->GetSubscriberService().GetPastEvents(eventMgrAddr)
+	//    the emitter is also woken up when any of the event managers emits
+	//    an event, and the push triggers only keep a weak reference to it,
+	//    so it's gone with the heartbeat emitter
+	std::shared_ptr<SubscriptionCounter::Token> subToken =
+		bcMgrPtr->GetPubSubSubCounter().MakeToken();
+	std::shared_ptr<PushTarget> pushTarget = std::make_shared<PushTarget>(
+		[sub, bcMgrPtr, subToken]()
+		{
+			EmitterHandler(*sub, *bcMgrPtr);
+		}
 	);
-	socket->SizedSendBytes(respMsg);
+	for (const auto& eventMgrAddr : eventMgrAddrs)
+	{
+		subSvc.GetPushTrigger(eventMgrAddr)->AddTarget(pushTarget);
+	}
 
-	// 4. set up heartbeat emitter
-	std::shared_ptr<LambdaMsgSocket> ownedSocket = std::move(socket);
+	std::shared_ptr<SubscriptionSlot> slot =
+		std::make_shared<SubscriptionSlot>(std::move(pushTarget));
+
+	// 5. tear down the subscription once the subscriber is disconnected;
+	//    the cursors, the queued messages, and the socket are released with
+	//    the slot
+	std::weak_ptr<SubscriptionSlot> weakSlot = slot;
+	outQueue->SetCloseCallback(
+		[weakSlot]()
+		{
+			std::shared_ptr<SubscriptionSlot> slot = weakSlot.lock();
+			if (slot != nullptr)
+			{
+				slot->Close();
+			}
+		}
+	);
 
 	HeartbeatEmitterMgr::GetInstance().AddEmitter(
-		[ownedSocket, eventQueue, bcMgrPtr, listenId]()
+		[slot]()
 		{
-			EmitterHandler(*ownedSocket, *eventQueue, *bcMgrPtr, listenId);
+			slot->Emit();
 		}
 	);
 
@@ -9,10 +9,13 @@
 #include <cstdint>
 
 #include <atomic>
+#include <iterator>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <DecentEnclave/Common/Logging.hpp>
@@ -25,6 +28,11 @@
 #include <SimpleObjects/SimpleObjects.hpp>
 #include <SimpleObjects/Codec/Hex.hpp>
 
+#include "../EventDispatcher.hpp"
+#include "../PushNotifier.hpp"
+#include "EmittedFrameCache.hpp"
+#include "PastEventLog.hpp"
+
 
 namespace DecentEthereum
 {
@@ -34,39 +42,6 @@ namespace Pubsub
 {
 
 
-/**
- * @brief The data structure that holds the event message and
- *        associated metadata; its structure should be
- *        1. SimpleObjects::Bytes - The block number when the event is emitted
- *        2. SimpleObjects::Bytes - The event message
- *
- */
-using EventData  = SimpleObjects::ListT<SimpleObjects::Bytes>;
-
-
-/**
- * @brief The data structure that holds a sequence of event data;
- *        It could be used to
- *        - store the past events
- *        - the events that are waiting to be pushed to the subscribers
- *
- */
-using EventDataQueue = SimpleObjects::ListT<EventData>;
-
-
-/**
- * @brief The data structure shared between the
- *        - Registered handler in EventManager (Block processing thread)
- *        - Heartbeat message emitter (Heartbeat thread)
- *
- */
-struct ThreadedEventQueue
-{
-	EventDataQueue  m_eventQueue;
-	std::mutex      m_mutex;
-}; // struct ThreadedEventQueue
-
-
 class SubscriberService
 {
 public: // static member:
@@ -99,7 +74,39 @@ public: // static member:
 	 */
 	using PastEventStore = std::unordered_map<
 		EventMgrId,
-		std::shared_ptr<ThreadedEventQueue>
+		std::shared_ptr<PastEventLog>
+	>;
+
+	/**
+	 * @brief The map used to store the frame caches of the event managers
+	 *        that have subscribers
+	 *
+	 */
+	using FrameCacheStore = std::unordered_map<
+		EventMgrId,
+		std::shared_ptr<EmittedFrameCache>
+	>;
+
+	/**
+	 * @brief The map used to store the frame caches of multiplexed
+	 *        subscriptions, keyed by the concatenated addresses of the
+	 *        event managers followed; they are held by the subscriptions,
+	 *        and dropped once all of them are gone
+	 *
+	 */
+	using MuxFrameCacheStore = std::unordered_map<
+		SimpleObjects::Bytes,
+		std::weak_ptr<EmittedFrameCache>
+	>;
+
+	/**
+	 * @brief The map used to store the push triggers of the event managers
+	 *        that have subscribers
+	 *
+	 */
+	using PushTriggerStore = std::unordered_map<
+		EventMgrId,
+		std::shared_ptr<PushTrigger>
 	>;
 
 	struct PubsubServiceStore
@@ -108,7 +115,9 @@ public: // static member:
 			const EclipseMonitor::Eth::ContractAddr& pubsubContAddr,
 			const std::string& deployEvSign,
 			const std::string& regEvSign,
-			const std::string& notifyEvSign
+			const std::string& notifyEvSign,
+			const EventRetention& retention,
+			const EventSpill& spill
 		) :
 			m_logger(
 				DecentEnclave::Common::LoggerFactory::
@@ -120,7 +129,16 @@ public: // static member:
 			m_notifyEvTopic(EclipseMonitor::Eth::Keccak256(notifyEvSign)),
 			m_isDeployed(false),
 			m_evMgrAddrMapMutex(),
-			m_evMgrAddrMap()
+			m_evMgrAddrMap(),
+			m_retention(retention),
+			m_spill(spill),
+			m_pastEventStoreMutex(),
+			m_pastEventStore(),
+			m_frameCacheStoreMutex(),
+			m_frameCacheStore(),
+			m_muxFrameCacheStore(),
+			m_pushTriggerStoreMutex(),
+			m_pushTriggerStore()
 		{}
 
 		DecentEnclave::Common::Logger m_logger;
@@ -131,8 +149,15 @@ public: // static member:
 		std::atomic_bool m_isDeployed;
 		std::mutex       m_evMgrAddrMapMutex;
 		EventMgrIdMap    m_evMgrAddrMap;
+		EventRetention   m_retention;
+		EventSpill       m_spill;
 		std::mutex       m_pastEventStoreMutex;
 		PastEventStore   m_pastEventStore;
+		std::mutex       m_frameCacheStoreMutex;
+		FrameCacheStore  m_frameCacheStore;
+		MuxFrameCacheStore m_muxFrameCacheStore;
+		std::mutex       m_pushTriggerStoreMutex;
+		PushTriggerStore m_pushTriggerStore;
 	}; // struct PubsubServiceStore
 
 public:
@@ -140,24 +165,240 @@ public:
 		const EclipseMonitor::Eth::ContractAddr& pubsubContAddr,
 		const std::string& deployEvSign,
 		const std::string& regEvSign,
-		const std::string& notifyEvSign
+		const std::string& notifyEvSign,
+		const EventRetention& retention = EventRetention(),
+		const EventSpill& spill = EventSpill()
 	) :
 		m_svcStore(std::make_shared<PubsubServiceStore>(
 			pubsubContAddr,
 			deployEvSign,
 			regEvSign,
-			notifyEvSign
+			notifyEvSign,
+			retention,
+			spill
 		))
 	{}
 
 	void Start(
-		std::shared_ptr<EclipseMonitor::Eth::EventManager> eventMgrPtr
+		std::shared_ptr<EventDispatcher> evDispatcherPtr
 	)
 	{
-		eventMgrPtr->Listen(BuildDeployEventDescr(
-			eventMgrPtr,
+		if (!m_svcStore->m_isDeployed.load())
+		{
+			evDispatcherPtr->Listen(BuildDeployEventDescr(
+				evDispatcherPtr,
+				m_svcStore
+			));
+			return;
+		}
+
+		// The service has been restored from a checkpoint, so we continue
+		// from where the deployment event handler would have left us
+		evDispatcherPtr->Listen(BuildRegEventDescr(
+			evDispatcherPtr,
 			m_svcStore
 		));
+
+		std::lock_guard<std::mutex> lock(m_svcStore->m_evMgrAddrMapMutex);
+		for (const auto& evMgrAddrPair : m_svcStore->m_evMgrAddrMap)
+		{
+			evDispatcherPtr->Listen(BuildNotifyPastEventDescr(
+				evMgrAddrPair.second,
+				m_svcStore
+			));
+		}
+	}
+
+	/**
+	 * @brief Build a checkpoint of the service, which includes the
+	 *        publisher registrations and the past event stores;
+	 *        for the spilled past events, only their keys and the label
+	 *        prefix they are sealed with are saved
+	 *        NOTE: events should not be dispatched while this is called,
+	 *        otherwise the registrations and the past events may
+	 *        belong to different blocks
+	 *
+	 */
+	SimpleObjects::Dict BuildCheckpoint() const
+	{
+		static const SimpleObjects::String sk_labelIsDeployed("IsDeployed");
+		static const SimpleObjects::String sk_labelRegs("Registrations");
+		static const SimpleObjects::String sk_labelPastEvents("PastEvents");
+		static const SimpleObjects::String sk_labelSpillLabel("SpillLabel");
+
+		SimpleObjects::List regs;
+		{
+			std::lock_guard<std::mutex> lock(m_svcStore->m_evMgrAddrMapMutex);
+			for (const auto& evMgrAddrPair : m_svcStore->m_evMgrAddrMap)
+			{
+				const auto& evMgrAddr = evMgrAddrPair.second;
+				regs.push_back(SimpleObjects::ListT<SimpleObjects::Bytes>({
+					evMgrAddrPair.first,
+					SimpleObjects::Bytes(evMgrAddr.begin(), evMgrAddr.end()),
+				}));
+			}
+		}
+
+		std::vector<std::pair<EventMgrId, PastEventCheckpoint> > pastEvChkpts;
+		{
+			std::lock_guard<std::mutex> lock(m_svcStore->m_pastEventStoreMutex);
+			for (const auto& storePair : m_svcStore->m_pastEventStore)
+			{
+				pastEvChkpts.emplace_back(
+					storePair.first,
+					storePair.second->GetCheckpoint()
+				);
+			}
+		}
+
+		// [evMgrId, hot events, first seq, spill keys, spill offset]
+		SimpleObjects::List pastEvents;
+		for (const auto& chkptPair : pastEvChkpts)
+		{
+			const PastEventCheckpoint& evChkpt = chkptPair.second;
+
+			SimpleObjects::List spillKeys;
+			for (const auto& key : evChkpt.m_spillKeys)
+			{
+				spillKeys.push_back(BlkNumToBytes(key));
+			}
+
+			SimpleObjects::List storeEntry;
+			storeEntry.push_back(chkptPair.first);
+			storeEntry.push_back(evChkpt.m_hotEvents.ToEventDataQueue());
+			storeEntry.push_back(BlkNumToBytes(evChkpt.m_firstSeq));
+			storeEntry.push_back(std::move(spillKeys));
+			storeEntry.push_back(BlkNumToBytes(evChkpt.m_spillOffset));
+			pastEvents.push_back(std::move(storeEntry));
+		}
+
+		const auto& spillStore = m_svcStore->m_spill.m_store;
+		const std::string spillLabel =
+			(spillStore != nullptr) ? spillStore->GetLabelPrefix() : "";
+
+		SimpleObjects::Dict chkpt;
+		chkpt[sk_labelIsDeployed] = SimpleObjects::Bytes({
+			static_cast<uint8_t>(m_svcStore->m_isDeployed.load() ? 1 : 0),
+		});
+		chkpt[sk_labelRegs] = std::move(regs);
+		chkpt[sk_labelPastEvents] = std::move(pastEvents);
+		chkpt[sk_labelSpillLabel] =
+			SimpleObjects::Bytes(spillLabel.begin(), spillLabel.end());
+		return chkpt;
+	}
+
+	/**
+	 * @brief Restore the service from the given checkpoint;
+	 *        it must be called before Start()
+	 *        The spilled past events are loaded from the host and sealed
+	 *        again for this run
+	 *
+	 */
+	void RestoreCheckpoint(const SimpleObjects::DictBaseObj& chkpt)
+	{
+		static const SimpleObjects::String sk_labelIsDeployed("IsDeployed");
+		static const SimpleObjects::String sk_labelRegs("Registrations");
+		static const SimpleObjects::String sk_labelPastEvents("PastEvents");
+		static const SimpleObjects::String sk_labelSpillLabel("SpillLabel");
+
+		const auto& isDeployed = chkpt[sk_labelIsDeployed].AsBytes();
+		m_svcStore->m_isDeployed.store(
+			(isDeployed.size() == 1) && (isDeployed[0] != 0)
+		);
+
+		{
+			std::lock_guard<std::mutex> lock(m_svcStore->m_evMgrAddrMapMutex);
+			m_svcStore->m_evMgrAddrMap.clear();
+			for (const auto& regObj : chkpt[sk_labelRegs].AsList())
+			{
+				const auto& regList = regObj.AsList();
+				const auto& pubAddr = regList[0].AsBytes();
+				const auto& evMgrAddrBytes = regList[1].AsBytes();
+
+				EclipseMonitor::Eth::ContractAddr evMgrAddr;
+				if (evMgrAddrBytes.size() != evMgrAddr.size())
+				{
+					throw std::runtime_error(
+						"Invalid event manager address in checkpoint"
+					);
+				}
+				std::copy(
+					evMgrAddrBytes.begin(),
+					evMgrAddrBytes.end(),
+					evMgrAddr.begin()
+				);
+
+				m_svcStore->m_evMgrAddrMap[
+					PublisherId(pubAddr.begin(), pubAddr.end())
+				] = evMgrAddr;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_svcStore->m_pastEventStoreMutex);
+			m_svcStore->m_pastEventStore.clear();
+			for (const auto& storeObj : chkpt[sk_labelPastEvents].AsList())
+			{
+				const auto& storeList = storeObj.AsList();
+				const auto& evMgrId = storeList[0].AsBytes();
+				// checkpoints taken before the sequence numbers were
+				// saved start from 0
+				const uint64_t firstSeq = (storeList.size() > 2) ?
+					BlkNumFromBytes(storeList[2].AsBytes()) :
+					0;
+
+				std::shared_ptr<PastEventLog> evLog =
+					std::make_shared<PastEventLog>(
+						m_svcStore->m_retention,
+						m_svcStore->m_spill,
+						firstSeq
+					);
+				// checkpoints taken before the spilled chunks were kept
+				// across runs have all events in the list
+				if (storeList.size() > 4)
+				{
+					std::vector<uint64_t> spillKeys;
+					for (const auto& keyObj : storeList[3].AsList())
+					{
+						spillKeys.push_back(BlkNumFromBytes(keyObj.AsBytes()));
+					}
+					if (!spillKeys.empty())
+					{
+						const auto& spillLabel =
+							chkpt[sk_labelSpillLabel].AsBytes();
+						evLog->RestoreSpilled(
+							std::string(spillLabel.begin(), spillLabel.end()),
+							spillKeys,
+							static_cast<size_t>(
+								BlkNumFromBytes(storeList[4].AsBytes())
+							)
+						);
+					}
+				}
+				for (const auto& evObj : storeList[1].AsList())
+				{
+					const auto& evList = evObj.AsList();
+					const auto& blkNum = evList[0].AsBytes();
+					const auto& evMsg = evList[1].AsBytes();
+
+					evLog->Append(
+						BlkNumFromBytes(blkNum),
+						std::vector<uint8_t>(evMsg.begin(), evMsg.end())
+					);
+				}
+
+				m_svcStore->m_pastEventStore.emplace(
+					EventMgrId(evMgrId.begin(), evMgrId.end()),
+					std::move(evLog)
+				);
+			}
+		}
+
+		m_svcStore->m_logger.Info(
+			"Restored " +
+			std::to_string(m_svcStore->m_evMgrAddrMap.size()) +
+			" publisher registrations from checkpoint"
+		);
 	}
 
 	EclipseMonitor::Eth::ContractAddr GetEventMgrAddr(
@@ -178,7 +419,15 @@ public:
 		return m_svcStore->m_notifyEvTopic;
 	}
 
-	EventDataQueue GetPastEvents(
+	/**
+	 * @brief Get the log of the events emitted by the given event manager;
+	 *        it's shared by all subscribers of that event manager, and is
+	 *        fed by the only listener of its notify events
+	 *
+	 * @return The event log, or nullptr if the event manager is not
+	 *         registered
+	 */
+	std::shared_ptr<const PastEventLog> GetPastEventLog(
 		const EclipseMonitor::Eth::ContractAddr& evMgrAddr
 	) const
 	{
@@ -186,15 +435,134 @@ public:
 			evMgrAddr.begin(),
 			evMgrAddr.end()
 		);
-		EventDataQueue pastEvents;
 
 		std::lock_guard<std::mutex> lock(m_svcStore->m_pastEventStoreMutex);
 		auto it = m_svcStore->m_pastEventStore.find(evMgrId);
-		if (it != m_svcStore->m_pastEventStore.end())
+		if (it == m_svcStore->m_pastEventStore.end())
+		{
+			return nullptr;
+		}
+		return it->second;
+	}
+
+	/**
+	 * @brief Get the cache of the messages emitted to the subscribers of
+	 *        the given event manager; it's created on first use
+	 *
+	 */
+	std::shared_ptr<EmittedFrameCache> GetEmittedFrameCache(
+		const EclipseMonitor::Eth::ContractAddr& evMgrAddr
+	) const
+	{
+		EventMgrId evMgrId(
+			evMgrAddr.begin(),
+			evMgrAddr.end()
+		);
+
+		std::lock_guard<std::mutex> lock(m_svcStore->m_frameCacheStoreMutex);
+		std::shared_ptr<EmittedFrameCache>& frameCache =
+			m_svcStore->m_frameCacheStore[evMgrId];
+		if (frameCache == nullptr)
 		{
-			pastEvents = it->second->m_eventQueue;
+			frameCache = std::make_shared<EmittedFrameCache>();
 		}
-		return pastEvents;
+		return frameCache;
+	}
+
+	/**
+	 * @brief Get the cache of the messages emitted to the multiplexed
+	 *        subscriptions following the given list of event managers, in
+	 *        the given order; it's created on first use
+	 *
+	 */
+	std::shared_ptr<EmittedFrameCache> GetEmittedFrameCache(
+		const std::vector<EclipseMonitor::Eth::ContractAddr>& evMgrAddrs
+	) const
+	{
+		std::vector<uint8_t> keyBytes;
+		for (const auto& evMgrAddr : evMgrAddrs)
+		{
+			keyBytes.insert(keyBytes.end(), evMgrAddr.begin(), evMgrAddr.end());
+		}
+		SimpleObjects::Bytes key(std::move(keyBytes));
+
+		std::lock_guard<std::mutex> lock(m_svcStore->m_frameCacheStoreMutex);
+		auto& store = m_svcStore->m_muxFrameCacheStore;
+		std::shared_ptr<EmittedFrameCache> frameCache = store[key].lock();
+		if (frameCache == nullptr)
+		{
+			// drop the caches of the lists no one follows anymore
+			for (auto it = store.begin(); it != store.end(); )
+			{
+				it = it->second.expired() ? store.erase(it) : std::next(it);
+			}
+			frameCache = std::make_shared<EmittedFrameCache>();
+			store[key] = frameCache;
+		}
+		return frameCache;
+	}
+
+	/**
+	 * @brief Get the trigger fired when the given event manager emits an
+	 *        event; it's created on first use
+	 *
+	 */
+	std::shared_ptr<PushTrigger> GetPushTrigger(
+		const EclipseMonitor::Eth::ContractAddr& evMgrAddr
+	) const
+	{
+		EventMgrId evMgrId(
+			evMgrAddr.begin(),
+			evMgrAddr.end()
+		);
+
+		std::lock_guard<std::mutex> lock(m_svcStore->m_pushTriggerStoreMutex);
+		std::shared_ptr<PushTrigger>& pushTrigger =
+			m_svcStore->m_pushTriggerStore[evMgrId];
+		if (pushTrigger == nullptr)
+		{
+			pushTrigger = std::make_shared<PushTrigger>();
+		}
+		return pushTrigger;
+	}
+
+	/**
+	 * @brief Evict the past events that are too old as of the given block,
+	 *        from the logs of all event managers
+	 *
+	 */
+	void EvictPastEvents(uint64_t latestBlkNum) const
+	{
+		std::vector<std::shared_ptr<PastEventLog> > evLogs;
+		{
+			std::lock_guard<std::mutex> lock(m_svcStore->m_pastEventStoreMutex);
+			evLogs.reserve(m_svcStore->m_pastEventStore.size());
+			for (const auto& storePair : m_svcStore->m_pastEventStore)
+			{
+				evLogs.push_back(storePair.second);
+			}
+		}
+
+		for (const auto& evLog : evLogs)
+		{
+			evLog->EvictByAge(latestBlkNum);
+		}
+	}
+
+	/**
+	 * @brief Get the counters of all past event logs
+	 *
+	 */
+	PastEventStats GetPastEventStats() const
+	{
+		PastEventStats stats;
+
+		std::lock_guard<std::mutex> lock(m_svcStore->m_pastEventStoreMutex);
+		for (const auto& storePair : m_svcStore->m_pastEventStore)
+		{
+			stats += storePair.second->GetStats();
+		}
+		return stats;
 	}
 
 private: // helper functions:
@@ -204,10 +572,36 @@ private: // helper functions:
 	static void NotifyPastEventHandler(
 		PubsubServiceStore& svcStore,
 		const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-		const EclipseMonitor::Eth::ReceiptLogEntry& log
+		const ReceiptLog& log
 	)
 	{
-		// 1. Extract event message from log data
+		// 1. Find the log of the event manager
+		EventMgrId evMgrId(
+			log.m_contractAddr.begin(),
+			log.m_contractAddr.end()
+		);
+		std::shared_ptr<PastEventLog> evLog;
+		{
+			std::lock_guard<std::mutex> lock(svcStore.m_pastEventStoreMutex);
+			auto it = svcStore.m_pastEventStore.find(evMgrId);
+			if (it != svcStore.m_pastEventStore.end())
+			{
+				evLog = it->second;
+			}
+			else
+			{
+				svcStore.m_logger.Error(
+					"Past event store not found for given event manager address"
+				);
+				return;
+			}
+		}
+
+		// 2. Extract event message from log data, and save it to the past
+		//    event store;
+		//    this is the only place the message is decoded, and the only
+		//    copy kept; the subscribers read it from the (refcounted,
+		//    immutable once full) chunks of the log
 		std::vector<uint8_t> evMsg;
 
 		using _MsgParser =
@@ -221,38 +615,24 @@ private: // helper functions:
 		std::tie(evMsg, abiBegin) =
 			_MsgParser().ToPrimitive(abiBegin, abiEnd, abiBegin);
 
-		// 2. Save event to pass event store
-		std::shared_ptr<ThreadedEventQueue> evQueue;
+		evLog->Append(headerMgr.GetNumber(), evMsg);
+
+		// 3. Wake up the subscribers, if there is any
+		std::shared_ptr<PushTrigger> pushTrigger;
 		{
-			EventMgrId evMgrId(
-				log.m_contractAddr.begin(),
-				log.m_contractAddr.end()
-			);
-			std::lock_guard<std::mutex> lock(svcStore.m_pastEventStoreMutex);
-			auto it = svcStore.m_pastEventStore.find(evMgrId);
-			if (it != svcStore.m_pastEventStore.end())
+			std::lock_guard<std::mutex> lock(svcStore.m_pushTriggerStoreMutex);
+			auto it = svcStore.m_pushTriggerStore.find(evMgrId);
+			if (it != svcStore.m_pushTriggerStore.end())
 			{
-				evQueue = it->second;
-			}
-			else
-			{
-				svcStore.m_logger.Error(
-					"Past event store not found for given event manager address"
-				);
-				return;
+				pushTrigger = it->second;
 			}
 		}
+		if (pushTrigger != nullptr)
 		{
-			std::lock_guard<std::mutex> lock(evQueue->m_mutex);
-			evQueue->m_eventQueue.push_back(
-				EventData({
-					EventData::value_type(headerMgr.GetRawHeader().get_Number()),
-					EventData::value_type(evMsg),
-				})
-			);
+			pushTrigger->Fire();
 		}
 
-		// 3. Debug message
+		// 4. Debug message
 		svcStore.m_logger.Debug(
 			std::string("Event Manager @") +
 			SimpleObjects::Codec::Hex::Encode<std::string>(log.m_contractAddr) +
@@ -261,21 +641,21 @@ private: // helper functions:
 		);
 	}
 
-	static EclipseMonitor::Eth::EventDescription
+	static EventDescription
 	BuildNotifyPastEventDescr(
 		const EclipseMonitor::Eth::ContractAddr& evMgrContAddr,
 		std::shared_ptr<PubsubServiceStore> svcStore
 	)
 	{
-		EclipseMonitor::Eth::EventDescription eventDesc(
+		EventDescription eventDesc(
 			evMgrContAddr,
 			std::vector<EclipseMonitor::Eth::EventTopic>({
 				svcStore->m_notifyEvTopic,
 			}),
 			[svcStore](
 				const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-				const EclipseMonitor::Eth::ReceiptLogEntry& log,
-				EclipseMonitor::Eth::EventCallbackId
+				const ReceiptLog& log,
+				EventListenerId
 			) -> void
 			{
 				NotifyPastEventHandler(*svcStore, headerMgr, log);
@@ -288,10 +668,10 @@ private: // helper functions:
 	// ===== Registration Event =====
 
 	static void RegEventHandler(
-		std::weak_ptr<EclipseMonitor::Eth::EventManager> weakEventMgr,
+		std::weak_ptr<EventDispatcher> weakEvDispatcher,
 		std::shared_ptr<PubsubServiceStore> svcStore,
 		const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-		const EclipseMonitor::Eth::ReceiptLogEntry& log
+		const ReceiptLog& log
 	)
 	{
 		// 1. Extract contract addresses from the receipt log
@@ -329,15 +709,18 @@ private: // helper functions:
 			std::lock_guard<std::mutex> lock(svcStore->m_pastEventStoreMutex);
 			svcStore->m_pastEventStore.emplace(
 				evMgrAddrBytes,
-				std::make_shared<ThreadedEventQueue>()
+				std::make_shared<PastEventLog>(
+					svcStore->m_retention,
+					svcStore->m_spill
+				)
 			);
 		}
 
 		// 3. Register event listening for the event manager
-		auto eventMgr = weakEventMgr.lock();
-		if (eventMgr)
+		auto evDispatcher = weakEvDispatcher.lock();
+		if (evDispatcher)
 		{
-			eventMgr->Listen(BuildNotifyPastEventDescr(
+			evDispatcher->Listen(BuildNotifyPastEventDescr(
 				evMgrAddr,
 				svcStore
 			));
@@ -355,24 +738,24 @@ private: // helper functions:
 		);
 	}
 
-	static EclipseMonitor::Eth::EventDescription
+	static EventDescription
 	BuildRegEventDescr(
-		std::weak_ptr<EclipseMonitor::Eth::EventManager> weakEventMgr,
+		std::weak_ptr<EventDispatcher> weakEvDispatcher,
 		std::shared_ptr<PubsubServiceStore> svcStore
 	)
 	{
-		EclipseMonitor::Eth::EventDescription eventDesc(
+		EventDescription eventDesc(
 			svcStore->m_pubsubContAddr,
 			std::vector<EclipseMonitor::Eth::EventTopic>({
 				svcStore->m_regEvTopic,
 			}),
-			[weakEventMgr, svcStore](
+			[weakEvDispatcher, svcStore](
 				const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-				const EclipseMonitor::Eth::ReceiptLogEntry& log,
-				EclipseMonitor::Eth::EventCallbackId
+				const ReceiptLog& log,
+				EventListenerId
 			) -> void
 			{
-				RegEventHandler(weakEventMgr, svcStore, headerMgr, log);
+				RegEventHandler(weakEvDispatcher, svcStore, headerMgr, log);
 			}
 		);
 
@@ -382,10 +765,10 @@ private: // helper functions:
 	//===== Deployment Event =====
 
 	static void DeployEventHandler(
-		std::weak_ptr<EclipseMonitor::Eth::EventManager> weakEventMgr,
+		std::weak_ptr<EventDispatcher> weakEvDispatcher,
 		std::shared_ptr<PubsubServiceStore> svcStore,
 		const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-		EclipseMonitor::Eth::EventCallbackId cbID
+		EventListenerId cbID
 	)
 	{
 		// 1. Mark the service as deployed
@@ -397,27 +780,27 @@ private: // helper functions:
 				std::to_string(headerMgr.GetNumber())
 		);
 
-		auto eventMgr = weakEventMgr.lock();
-		if (eventMgr)
+		auto evDispatcher = weakEvDispatcher.lock();
+		if (evDispatcher)
 		{
 			// 3. stop listening to this event since it is already deployed
-			eventMgr->Cancel(cbID);
+			evDispatcher->Cancel(cbID);
 
 			// 4. now we can start listening to registration events
-			eventMgr->Listen(BuildRegEventDescr(
-				weakEventMgr,
+			evDispatcher->Listen(BuildRegEventDescr(
+				weakEvDispatcher,
 				svcStore
 			));
 		}
 	}
 
-	static EclipseMonitor::Eth::EventDescription
+	static EventDescription
 	BuildDeployEventDescr(
-		std::weak_ptr<EclipseMonitor::Eth::EventManager> weakEventMgr,
+		std::weak_ptr<EventDispatcher> weakEvDispatcher,
 		std::shared_ptr<PubsubServiceStore> svcStore
 	)
 	{
-		EclipseMonitor::Eth::EventDescription eventDesc(
+		EventDescription eventDesc(
 			svcStore->m_pubsubContAddr,
 			std::vector<EclipseMonitor::Eth::EventTopic>({
 				svcStore->m_deployEvTopic,
@@ -425,13 +808,13 @@ private: // helper functions:
 					svcStore->m_pubsubContAddr
 				),
 			}),
-			[weakEventMgr, svcStore](
+			[weakEvDispatcher, svcStore](
 				const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-				const EclipseMonitor::Eth::ReceiptLogEntry&,
-				EclipseMonitor::Eth::EventCallbackId cbID
+				const ReceiptLog&,
+				EventListenerId cbID
 			) -> void
 			{
-				DeployEventHandler(weakEventMgr, svcStore, headerMgr, cbID);
+				DeployEventHandler(weakEvDispatcher, svcStore, headerMgr, cbID);
 			}
 		);
 
@@ -0,0 +1,229 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sgx_error.h>
+
+#include <DecentEnclave/Common/Logging.hpp>
+
+#include "EnclaveWorkerPool.hpp"
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_schedule_push(
+	sgx_status_t* retval
+);
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief The function that emits the pending data to one subscriber;
+ *        it's the same function called by the heartbeat emitter
+ *
+ */
+using PushTarget = std::function<void()>;
+
+
+/**
+ * @brief Wakes up the subscribers of one source of events (e.g., an event
+ *        manager) when new events come in; the subscribers are held by
+ *        weak pointers, so they are gone once the heartbeat emitter drops
+ *        them
+ *
+ */
+class PushTrigger :
+	public std::enable_shared_from_this<PushTrigger>
+{
+public:
+
+	PushTrigger() :
+		m_isPending(false),
+		m_mutex(),
+		m_targets()
+	{}
+
+	~PushTrigger() = default;
+
+	void AddTarget(std::weak_ptr<PushTarget> target)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_targets.push_back(std::move(target));
+	}
+
+	/**
+	 * @brief Mark that new events have come in; the subscribers will be
+	 *        woken up at the next push tick
+	 *
+	 */
+	inline void Fire();
+
+	/**
+	 * @brief Call all the subscribers that are still alive; each of them
+	 *        is called by a task on the outbound worker pool, so they are
+	 *        emitted in parallel
+	 *
+	 */
+	void Flush(DecentEnclave::Common::Logger& logger)
+	{
+		m_isPending.store(false);
+
+		std::vector<std::shared_ptr<PushTarget> > targets;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::vector<std::weak_ptr<PushTarget> > liveTargets;
+			for (const auto& weakTarget : m_targets)
+			{
+				std::shared_ptr<PushTarget> target = weakTarget.lock();
+				if (target != nullptr)
+				{
+					liveTargets.push_back(weakTarget);
+					targets.push_back(std::move(target));
+				}
+			}
+			m_targets.swap(liveTargets);
+		}
+
+		for (auto& target : targets)
+		{
+			EnclaveWorkerPool::GetOutboundInstance().AddTask(
+				[target, &logger]()
+				{
+					try
+					{
+						(*target)();
+					}
+					catch (const std::exception& e)
+					{
+						// the heartbeat emitter will run into the same error
+						// and drop the subscriber
+						logger.Debug(
+							std::string("Failed to push: ") + e.what()
+						);
+					}
+				}
+			);
+		}
+	}
+
+private:
+
+	std::atomic_bool m_isPending;
+	std::mutex m_mutex;
+	std::vector<std::weak_ptr<PushTarget> > m_targets;
+}; // class PushTrigger
+
+
+/**
+ * @brief Collects the triggers fired since the last push tick;
+ *        the first trigger fired after a tick asks the host to schedule
+ *        a single tick one coalescing window later, so events that come in
+ *        within the window are pushed together, instead of waiting for the
+ *        next heartbeat, and the host doesn't tick while nothing comes in
+ *
+ */
+class PushNotifier
+{
+public: // static members:
+
+	static PushNotifier& GetInstance()
+	{
+		static PushNotifier s_inst;
+		return s_inst;
+	}
+
+public:
+
+	PushNotifier() :
+		m_logger(
+			DecentEnclave::Common::LoggerFactory::GetLogger("PushNotifier")
+		),
+		m_mutex(),
+		m_pending()
+	{}
+
+	~PushNotifier() = default;
+
+	void AddPending(std::shared_ptr<PushTrigger> trigger)
+	{
+		bool isFirst = false;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			isFirst = m_pending.empty();
+			m_pending.push_back(std::move(trigger));
+		}
+
+		if (isFirst)
+		{
+			SchedulePush();
+		}
+	}
+
+	/**
+	 * @brief Wake up the subscribers of all triggers fired since the last
+	 *        tick; it's called by the host at the push tick scheduled
+	 *
+	 */
+	void Tick()
+	{
+		std::vector<std::shared_ptr<PushTrigger> > pending;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			pending.swap(m_pending);
+		}
+
+		for (const auto& trigger : pending)
+		{
+			trigger->Flush(m_logger);
+		}
+	}
+
+private: // helper functions:
+
+	void SchedulePush()
+	{
+		sgx_status_t retval = SGX_ERROR_UNEXPECTED;
+		const sgx_status_t edgeRet =
+			ocall_decent_ethereum_schedule_push(&retval);
+		if ((edgeRet != SGX_SUCCESS) || (retval != SGX_SUCCESS))
+		{
+			// the events are still sent by the next heartbeat
+			m_logger.Error("Failed to schedule a push tick");
+		}
+	}
+
+private:
+
+	DecentEnclave::Common::Logger m_logger;
+	std::mutex m_mutex;
+	std::vector<std::shared_ptr<PushTrigger> > m_pending;
+}; // class PushNotifier
+
+
+inline void PushTrigger::Fire()
+{
+	// only queued once until it's flushed
+	if (!m_isPending.exchange(true))
+	{
+		PushNotifier::GetInstance().AddPending(shared_from_this());
+	}
+}
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,114 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include <EclipseMonitor/Eth/DataTypes.hpp>
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief The topics accepted at one position of a log;
+ *        any of them matches, and an empty set matches any topic
+ *
+ */
+using TopicSet = std::vector<EclipseMonitor::Eth::EventTopic>;
+
+
+/**
+ * @brief Describes the logs a listener is interested in, in the same way as
+ *        the filters of eth_getLogs:
+ *        the log must be emitted by any of the given contracts, and, for
+ *        each given position, the topic of the log at that position must be
+ *        in the topic set of that position (or the set is empty, i.e.,
+ *        a wildcard); the log must have at least as many topics as the
+ *        number of given positions
+ *
+ */
+struct ReceiptFilter
+{
+	// a log has at most 4 topics, so a filter with more positions never
+	// matches anything
+	static constexpr size_t sk_maxTopicSets = 4;
+
+	/**
+	 * @brief Build a filter matching the logs from a single contract, with
+	 *        the given leading topics
+	 *
+	 */
+	static ReceiptFilter Exact(
+		const EclipseMonitor::Eth::ContractAddr& contractAddr,
+		const std::vector<EclipseMonitor::Eth::EventTopic>& topics
+	)
+	{
+		ReceiptFilter filter;
+		filter.m_contractAddrs.push_back(contractAddr);
+		filter.m_topicSets.reserve(topics.size());
+		for (const auto& topic : topics)
+		{
+			filter.m_topicSets.push_back(TopicSet({ topic }));
+		}
+		return filter;
+	}
+
+	ReceiptFilter() :
+		m_contractAddrs(),
+		m_topicSets()
+	{}
+
+	/**
+	 * @brief Sort the addresses and the topic sets, and remove the
+	 *        duplicates in them, so a log matches each (address, topic
+	 *        combination) of the filter at most once
+	 *
+	 */
+	void Normalize()
+	{
+		SortUnique(m_contractAddrs);
+		for (auto& topicSet : m_topicSets)
+		{
+			SortUnique(topicSet);
+		}
+	}
+
+	/**
+	 * @brief Order the filters, so identical (normalized) filters can be
+	 *        grouped together
+	 *
+	 */
+	bool operator<(const ReceiptFilter& other) const
+	{
+		return std::tie(m_contractAddrs, m_topicSets) <
+			std::tie(other.m_contractAddrs, other.m_topicSets);
+	}
+
+	std::vector<EclipseMonitor::Eth::ContractAddr> m_contractAddrs;
+	std::vector<TopicSet>                          m_topicSets;
+
+private: // helper functions:
+
+	template<typename _ItemType>
+	static void SortUnique(std::vector<_ItemType>& items)
+	{
+		std::sort(items.begin(), items.end());
+		items.erase(std::unique(items.begin(), items.end()), items.end());
+	}
+}; // struct ReceiptFilter
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
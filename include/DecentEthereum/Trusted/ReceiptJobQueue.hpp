@@ -0,0 +1,324 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <EclipseMonitor/Eth/DataTypes.hpp>
+#include <EclipseMonitor/Eth/HeaderMgr.hpp>
+#include <SimpleObjects/SimpleObjects.hpp>
+
+#include "EnclaveWorkerPool.hpp"
+#include "ReceiptLog.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A queue of receipt jobs; each job fetches the receipts of a block,
+ *        verifies them against the receipts root (i.e., builds the trie),
+ *        and (optionally) extracts the logs.
+ *        Jobs are run in parallel on the EnclaveWorkerPool, but they are
+ *        always committed in the order they were submitted.
+ *        A job that failed stays at the front of the queue, and is retried
+ *        by every Commit call until it succeeds, so the events of a block
+ *        are never skipped, and no later block is committed before it.
+ *
+ */
+class ReceiptJobQueue
+{
+public: // static members:
+
+	using HeaderPtr = std::shared_ptr<const EclipseMonitor::Eth::HeaderMgr>;
+
+	using ReceiptsGetter =
+		std::function<SimpleObjects::Object(EclipseMonitor::Eth::BlockNumber)>;
+
+	using ReceiptsPtr = std::shared_ptr<const SimpleObjects::Object>;
+
+	struct Job
+	{
+		Job(HeaderPtr hdr, bool needReceipts, uint64_t filterVer) :
+			m_hdr(std::move(hdr)),
+			m_filterVer(filterVer),
+			m_hasReceipts(false),
+			m_fetchedReceipts(),
+			m_logs(),
+			m_error(),
+			m_isDone(!needReceipts),
+			m_isDeferred(false)
+		{}
+
+		HeaderPtr               m_hdr;
+		uint64_t                m_filterVer;
+		bool                    m_hasReceipts;
+		// the receipts fetched by the submitter, if any; they are used
+		// instead of fetching them again, and released once processed
+		ReceiptsPtr             m_fetchedReceipts;
+		std::vector<ReceiptLog> m_logs;
+		std::exception_ptr      m_error;
+		bool                    m_isDone;
+		bool                    m_isDeferred;
+	}; // struct Job
+
+	using JobPtr = std::shared_ptr<Job>;
+
+	// number of times the receipts are fetched before a job fails
+	static constexpr size_t sk_maxAttempts = 3;
+
+public:
+
+	ReceiptJobQueue(
+		ReceiptsGetter receiptsGetter,
+		bool parseLogs,
+		EnclaveWorkerPool& workerPool = EnclaveWorkerPool::GetInstance()
+	) :
+		m_receiptsGetter(std::move(receiptsGetter)),
+		m_parseLogs(parseLogs),
+		m_workerPool(workerPool),
+		m_mutex(),
+		m_doneCond(),
+		m_jobs()
+	{}
+
+	~ReceiptJobQueue()
+	{
+		// workers are still referencing this queue, wait for them
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_doneCond.wait(
+			lock,
+			[this]()
+			{
+				for (const auto& job : m_jobs)
+				{
+					if (!job->m_isDone && !job->m_isDeferred)
+					{
+						return false;
+					}
+				}
+				return true;
+			}
+		);
+	}
+
+	/**
+	 * @brief Fetch, verify, and parse the receipts of the given job
+	 *        in the current thread; the receipts given at submission, if
+	 *        any, are tried first;
+	 *        the receipts are fetched again if the host fails to give them
+	 *        or gives the wrong ones, up to sk_maxAttempts times
+	 *
+	 * @exception the error thrown by the last attempt
+	 */
+	void ProcessJob(Job& job) const
+	{
+		for (size_t attempt = 1; ; ++attempt)
+		{
+			try
+			{
+				// the given receipts are only tried once
+				ReceiptsPtr receipts = std::move(job.m_fetchedReceipts);
+				if (receipts == nullptr)
+				{
+					receipts = std::make_shared<const SimpleObjects::Object>(
+						m_receiptsGetter(job.m_hdr->GetNumber())
+					);
+				}
+				const auto& receiptsList = receipts->AsList();
+
+				job.m_logs =
+					VerifyReceipts(*job.m_hdr, receiptsList, m_parseLogs);
+				job.m_hasReceipts = true;
+				return;
+			}
+			catch (const std::exception&)
+			{
+				if (attempt >= sk_maxAttempts)
+				{
+					throw;
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief Submit a block to the queue
+	 *
+	 * @param hdr          The header of the block
+	 * @param needReceipts Whether the receipts of this block are needed;
+	 *                     if not, the job is only a placeholder that keeps
+	 *                     the commit order
+	 * @param filterVer    The version of the filter used to decide if the
+	 *                     receipts are needed
+	 * @param receipts     The receipts of the block, if the caller has
+	 *                     fetched them already, so they are not fetched
+	 *                     again; they are still verified by the job
+	 *        NOTE: if there is no worker available, the receipts will be
+	 *        processed by the thread calling Commit, rather than the
+	 *        calling thread, since the caller may be holding a lock
+	 */
+	void Submit(
+		HeaderPtr hdr,
+		bool needReceipts,
+		uint64_t filterVer = 0,
+		ReceiptsPtr receipts = ReceiptsPtr()
+	)
+	{
+		JobPtr job =
+			std::make_shared<Job>(std::move(hdr), needReceipts, filterVer);
+		job->m_fetchedReceipts = std::move(receipts);
+		job->m_isDeferred =
+			needReceipts && (m_workerPool.GetNumWorkers() == 0);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_jobs.push_back(job);
+		}
+
+		if (needReceipts && !job->m_isDeferred)
+		{
+			m_workerPool.AddTask(
+				[this, job]()
+				{
+					std::exception_ptr error;
+					try
+					{
+						ProcessJob(*job);
+					}
+					catch (...)
+					{
+						error = std::current_exception();
+					}
+
+					std::lock_guard<std::mutex> lock(m_mutex);
+					job->m_error = error;
+					job->m_isDone = true;
+					m_doneCond.notify_all();
+				}
+			);
+		}
+	}
+
+	/**
+	 * @brief Commit the finished jobs in the order they were submitted;
+	 *        a job is only removed from the queue once its receipts have
+	 *        been processed, so if it fails, the following calls retry it
+	 *        rather than committing the later blocks
+	 *
+	 * @param isLateNeeded A function that takes a const Job& of a block
+	 *                     whose receipts were not needed when it was
+	 *                     submitted, and tells if they are needed now
+	 * @param commitFunc   A function that takes a Job&
+	 * @param maxPending   The max number of jobs allowed to be left pending;
+	 *                     if there are more, this call blocks until enough
+	 *                     jobs are finished and committed
+	 * @exception the error thrown while processing the job at the front
+	 */
+	template<typename _LateNeededFunc, typename _CommitFunc>
+	void Commit(
+		_LateNeededFunc&& isLateNeeded,
+		_CommitFunc&& commitFunc,
+		size_t maxPending
+	)
+	{
+		while (true)
+		{
+			JobPtr job;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (m_jobs.empty())
+				{
+					return;
+				}
+
+				const Job& front = *m_jobs.front();
+				if (!front.m_isDone && !front.m_isDeferred)
+				{
+					if (m_jobs.size() <= maxPending)
+					{
+						return;
+					}
+					m_doneCond.wait(
+						lock,
+						[this]() { return m_jobs.front()->m_isDone; }
+					);
+				}
+
+				// the job stays at the front until it's processed
+				job = m_jobs.front();
+			}
+
+			const bool needProcess =
+				job->m_isDeferred ||
+				job->m_error ||
+				(!job->m_hasReceipts && isLateNeeded(*job));
+			if (needProcess)
+			{
+				try
+				{
+					ProcessJob(*job);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					job->m_error = std::current_exception();
+					throw;
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				job->m_error = nullptr;
+				m_jobs.pop_front();
+			}
+
+			commitFunc(*job);
+		}
+	}
+
+	/**
+	 * @brief Check if the job at the front of the queue has failed, i.e.,
+	 *        no more block should be taken until it's committed
+	 *
+	 */
+	bool HasFailedJob() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return !m_jobs.empty() && (m_jobs.front()->m_error != nullptr);
+	}
+
+	size_t GetNumPending() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_jobs.size();
+	}
+
+private:
+
+	ReceiptsGetter m_receiptsGetter;
+	bool m_parseLogs;
+	EnclaveWorkerPool& m_workerPool;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_doneCond;
+	std::deque<JobPtr> m_jobs;
+}; // class ReceiptJobQueue
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,309 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <DecentEnclave/Common/Logging.hpp>
+#include <EclipseMonitor/Eth/HeaderMgr.hpp>
+#include <SimpleObjects/Codec/Hex.hpp>
+
+#include "EventDispatcher.hpp"
+#include "Pubsub/EmittedFrameCache.hpp"
+#include "PushNotifier.hpp"
+#include "ReceiptFilter.hpp"
+#include "ReceiptLog.hpp"
+#include "ReceiptView.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+using ReceiptQueue = std::vector<ReceiptRecordPtr>;
+
+
+struct ThreadedReceiptQueue
+{
+	ThreadedReceiptQueue() :
+		m_receiptQueue(),
+		m_beginSeq(0),
+		m_mutex(),
+		m_frameCache(),
+		m_pushTrigger(std::make_shared<PushTrigger>()),
+		m_emitMutex()
+	{}
+
+	ReceiptQueue  m_receiptQueue;
+	// the sequence number (in the listener group) of the first record in
+	// the queue; the records of a group are queued in order, so the range
+	// of records identifies the content of the message carrying them
+	uint64_t      m_beginSeq;
+	std::mutex    m_mutex;
+	// the cache of the messages of the listener group joined
+	std::shared_ptr<Pubsub::EmittedFrameCache> m_frameCache;
+	// fired when receipts are queued
+	std::shared_ptr<PushTrigger> m_pushTrigger;
+	// emitted by both the heartbeat and the push tick
+	std::mutex    m_emitMutex;
+}; // struct ThreadedReceiptQueue
+
+
+/**
+ * @brief Groups the Receipt.Subscribe subscriptions with identical
+ *        filters and views under one dispatcher listener;
+ *        each matched log is checked against the predicates of the view
+ *        and projected once, into one record, which is shared by the
+ *        queues of all subscriptions in the group;
+ *        the messages carrying the records are cached per group, so
+ *        subscriptions emitting the same range of records send the same
+ *        encoded buffer
+ *
+ */
+class ReceiptListenerGroups
+{
+public: // static members:
+
+	using GroupKey = std::pair<ReceiptFilter, ReceiptView>;
+
+	/**
+	 * @brief The subscriptions sharing one dispatcher listener
+	 *
+	 */
+	class Group
+	{
+	public:
+
+		Group(const ReceiptFilter& filter, const ReceiptView& view) :
+			m_logger(
+				DecentEnclave::Common::LoggerFactory::GetLogger(
+					std::string("Receipt from ") +
+						SimpleObjects::Codec::Hex::
+							Encode<std::string>(filter.m_contractAddrs[0])
+				)
+			),
+			m_key(filter, view),
+			m_listenId(0),
+			m_mutex(),
+			m_nextSeq(0),
+			m_queues(),
+			m_frameCache(std::make_shared<Pubsub::EmittedFrameCache>())
+		{}
+
+		~Group() = default;
+
+		void OnLog(
+			const EclipseMonitor::Eth::HeaderMgr& headerMgr,
+			const ReceiptLog& log
+		)
+		{
+			if (!m_key.second.IsMatch(log))
+			{
+				return;
+			}
+
+			std::vector<std::shared_ptr<ThreadedReceiptQueue> > queues;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				queues.reserve(m_queues.size());
+				for (const auto& weakQueue : m_queues)
+				{
+					std::shared_ptr<ThreadedReceiptQueue> queue =
+						weakQueue.lock();
+					if (queue != nullptr)
+					{
+						queues.push_back(std::move(queue));
+					}
+				}
+				if (queues.empty())
+				{
+					return;
+				}
+
+				// 1. Build the record once for the whole group
+				ReceiptRecordPtr record =
+					m_key.second.BuildRecord(headerMgr, log);
+				const uint64_t seq = m_nextSeq++;
+
+				// 2. Save it to the queue of each subscription;
+				//    it's done under the lock of the group, so the records
+				//    are queued in the order of their sequence numbers
+				for (const auto& queue : queues)
+				{
+					std::lock_guard<std::mutex> queueLock(queue->m_mutex);
+					if (queue->m_receiptQueue.empty())
+					{
+						queue->m_beginSeq = seq;
+					}
+					queue->m_receiptQueue.push_back(record);
+				}
+			}
+
+			for (const auto& queue : queues)
+			{
+				queue->m_pushTrigger->Fire();
+			}
+
+			// 3. Debug message
+			m_logger.Debug(
+				"Emit an event at block #" +
+				std::to_string(headerMgr.GetNumber()) + " to " +
+				std::to_string(queues.size()) + " subscriber(s)"
+			);
+		}
+
+	private:
+
+		friend class ReceiptListenerGroups;
+
+		DecentEnclave::Common::Logger m_logger;
+		GroupKey m_key;
+		EventListenerId m_listenId;
+		std::mutex m_mutex;
+		uint64_t m_nextSeq;
+		std::vector<std::weak_ptr<ThreadedReceiptQueue> > m_queues;
+		std::shared_ptr<Pubsub::EmittedFrameCache> m_frameCache;
+	}; // class Group
+
+	using GroupPtr = std::shared_ptr<Group>;
+
+public:
+
+	ReceiptListenerGroups(std::shared_ptr<EventDispatcher> dispatcher) :
+		m_dispatcher(std::move(dispatcher)),
+		m_mutex(),
+		m_groups(),
+		m_idleFrameCache()
+	{}
+
+	~ReceiptListenerGroups() = default;
+
+	/**
+	 * @brief Add the given queue to the group of the given filter and
+	 *        view; the group (and its listener) is created if it doesn't
+	 *        exist
+	 *
+	 * @return The group joined, which is needed to leave it
+	 */
+	GroupPtr Join(
+		ReceiptFilter filter,
+		ReceiptView view,
+		std::shared_ptr<ThreadedReceiptQueue> queue
+	)
+	{
+		filter.Normalize();
+		view.Normalize();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		GroupPtr& group = m_groups[GroupKey(filter, view)];
+		if (group == nullptr)
+		{
+			group = std::make_shared<Group>(filter, view);
+
+			GroupPtr groupRef = group;
+			group->m_listenId = m_dispatcher->Listen(EventDescription(
+				filter,
+				[groupRef](
+					const EclipseMonitor::Eth::HeaderMgr& headerMgr,
+					const ReceiptLog& log,
+					EventListenerId
+				) -> void
+				{
+					groupRef->OnLog(headerMgr, log);
+				}
+			));
+		}
+
+		{
+			std::lock_guard<std::mutex> groupLock(group->m_mutex);
+			{
+				std::lock_guard<std::mutex> queueLock(queue->m_mutex);
+				queue->m_frameCache = group->m_frameCache;
+			}
+			group->m_queues.push_back(std::move(queue));
+		}
+
+		return group;
+	}
+
+	/**
+	 * @brief Remove the given queue from the given group;
+	 *        the listener of the group is cancelled once the group is empty
+	 *
+	 */
+	void Leave(const GroupPtr& group, const ThreadedReceiptQueue* queue)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		bool isEmpty = false;
+		{
+			std::lock_guard<std::mutex> groupLock(group->m_mutex);
+			auto& queues = group->m_queues;
+			for (auto it = queues.begin(); it != queues.end(); )
+			{
+				std::shared_ptr<ThreadedReceiptQueue> ptr = it->lock();
+				if ((ptr == nullptr) || (ptr.get() == queue))
+				{
+					it = queues.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+			isEmpty = queues.empty();
+		}
+
+		if (isEmpty)
+		{
+			auto it = m_groups.find(group->m_key);
+			if ((it != m_groups.end()) && (it->second == group))
+			{
+				m_groups.erase(it);
+			}
+			m_dispatcher->Cancel(group->m_listenId);
+		}
+	}
+
+	size_t GetNumGroups() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_groups.size();
+	}
+
+	/**
+	 * @brief Get the cache of the messages carrying no receipt, which are
+	 *        the same for all subscriptions within a heartbeat
+	 *
+	 */
+	Pubsub::EmittedFrameCache& GetIdleFrameCache()
+	{
+		return m_idleFrameCache;
+	}
+
+private:
+
+	std::shared_ptr<EventDispatcher> m_dispatcher;
+	mutable std::mutex m_mutex;
+	std::map<GroupKey, GroupPtr> m_groups;
+	Pubsub::EmittedFrameCache m_idleFrameCache;
+}; // class ReceiptListenerGroups
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,75 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <EclipseMonitor/Eth/HeaderMgr.hpp>
+#include <EclipseMonitor/Eth/ReceiptsMgr.hpp>
+#include <SimpleObjects/SimpleObjects.hpp>
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A single log entry emitted in a transaction receipt, as parsed by
+ *        the ReceiptsMgr of the Eclipse Monitor
+ *
+ */
+using ReceiptLog = EclipseMonitor::Eth::ReceiptLogEntry;
+
+
+/**
+ * @brief Verify the given list of receipts against the receipts root in the
+ *        given header, and extract all logs from them, in the order they
+ *        were emitted in the block;
+ *        the receipts are parsed only once, by the same ReceiptsMgr that
+ *        builds the trie, which is also the one used by the EventManager
+ *
+ * @param receipts  The list of (RLP-encoded) receipts of a block
+ * @param parseLogs Whether the logs are needed
+ * @exception std::runtime_error if the receipts root doesn't match
+ */
+inline std::vector<ReceiptLog> VerifyReceipts(
+	const EclipseMonitor::Eth::HeaderMgr& hdr,
+	const SimpleObjects::ListBaseObj& receipts,
+	bool parseLogs
+)
+{
+	EclipseMonitor::Eth::ReceiptsMgr receiptsMgr(receipts);
+	if (
+		receiptsMgr.GetRootHashBytes() !=
+		hdr.GetRawHeader().get_ReceiptsRoot()
+	)
+	{
+		throw std::runtime_error(
+			"Receipts root mismatch at block #" +
+			std::to_string(hdr.GetNumber())
+		);
+	}
+
+	std::vector<ReceiptLog> logs;
+	if (parseLogs)
+	{
+		for (const auto& receipt : receiptsMgr.GetReceipts())
+		{
+			const auto& entries = receipt.GetLogEntries();
+			logs.insert(logs.end(), entries.begin(), entries.end());
+		}
+	}
+	return logs;
+}
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
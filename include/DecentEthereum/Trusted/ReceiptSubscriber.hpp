@@ -6,7 +6,14 @@
 #pragma once
 
 
+#include <cstdint>
+
+#include <algorithm>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <DecentEnclave/Common/Logging.hpp>
 #include <DecentEnclave/Trusted/DecentLambdaSvr.hpp>
@@ -16,6 +23,12 @@
 
 #include "BlockchainMgr.hpp"
 #include "DataType.hpp"
+#include "OutboundQueue.hpp"
+#include "PushNotifier.hpp"
+#include "ReceiptFilter.hpp"
+#include "ReceiptListenerGroups.hpp"
+#include "ReceiptView.hpp"
+#include "SubscriptionLifecycle.hpp"
 
 
 namespace DecentEthereum
@@ -24,124 +37,332 @@ namespace Trusted
 {
 
 
-using ReceiptQueue = SimpleObjects::ListT<SimpleObjects::Object>;
+template<typename _NetConfig>
+inline std::vector<uint8_t> BuildReceiptMsg(
+	const typename BlockchainMgr<_NetConfig>::MonitorSnapshot& snapshot,
+	const ReceiptQueue& records
+)
+{
+	static const SimpleObjects::String sk_labelSecState("SecState");
+	static const SimpleObjects::String sk_labelLatestBlkNum("LatestBlkNum");
+	static const SimpleObjects::String sk_labelReceipts("Receipts");
 
+	// the records are shared with other subscriptions, so they are
+	// only copied into the message being written
+	SimpleObjects::List outReceipts;
+	outReceipts.reserve(records.size());
+	for (const auto& record : records)
+	{
+		outReceipts.push_back(*record);
+	}
 
-struct ThreadedReceiptQueue
-{
-	ReceiptQueue  m_receiptQueue;
-	std::mutex    m_mutex;
-}; // struct ThreadedReceiptQueue
+	SimpleObjects::Dict respDict;
+	respDict[sk_labelSecState] = *(snapshot.m_secStateRlp);
+	respDict[sk_labelLatestBlkNum] = snapshot.m_lastValidatedBlkNum;
+	respDict[sk_labelReceipts] = std::move(outReceipts);
+
+	return AdvancedRlp::GenericWriter::Write(respDict);
+}
 
 
-inline void SubscribedReceiptHandler(
+template<typename _NetConfig>
+inline void SubscribedReceiptEmitter(
+	OutboundQueue& outQueue,
 	ThreadedReceiptQueue& recQueue,
-	DecentEnclave::Common::Logger& logger,
-	const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-	const EclipseMonitor::Eth::ReceiptLogEntry& log
+	BlockchainMgr<_NetConfig>& bcMgr
 )
 {
-	// 1. Copy log data
-	SimpleObjects::List topics;
-	topics.reserve(log.m_topics.size());
-	for (const auto& topic : log.m_topics)
+	std::lock_guard<std::mutex> emitLock(recQueue.m_emitMutex);
+
+	try
 	{
-		topics.push_back(SimpleObjects::Bytes(
-			std::vector<uint8_t>(topic.begin(), topic.end())
-		));
-	}
-	SimpleObjects::List list;
-	list.push_back(SimpleObjects::Bytes(headerMgr.GetRawHeader().get_Number()));
-	list.push_back(std::move(topics));
-	list.push_back(SimpleObjects::Bytes(log.m_logData));
+		if (!outQueue.HasRoom())
+		{
+			// the receipts are kept in the queue until a later heartbeat
+			return;
+		}
+
+		ReceiptQueue records;
+		uint64_t beginSeq = 0;
+		std::shared_ptr<Pubsub::EmittedFrameCache> frameCache;
+		{
+			std::lock_guard<std::mutex> lock(recQueue.m_mutex);
+			records.swap(recQueue.m_receiptQueue);
+			beginSeq = recQueue.m_beginSeq;
+			frameCache = recQueue.m_frameCache;
+		}
+
+		auto snapshot = bcMgr.GetMonitorSnapshot();
+
+		// most heartbeats carry no receipt, so the message (and the
+		// secure state in it) is built once and sent to all subscribers;
+		// otherwise, it's built once for the subscribers of the same
+		// group that emit the same range of records
+		Pubsub::EmittedFrameCache& cache = records.empty() ?
+			bcMgr.GetReceiptListenerGroups().GetIdleFrameCache() :
+			*frameCache;
+		const auto& curr = *snapshot;
+		OutboundQueue::FramePtr frame = cache.GetOrBuild(
+			0,
+			nullptr,
+			std::move(snapshot),
+			records.empty() ? 0 : beginSeq,
+			records.empty() ? 0 : (beginSeq + records.size()),
+			[&curr, &records]()
+			{
+				return BuildReceiptMsg<_NetConfig>(curr, records);
+			}
+		);
 
-	// 2. Save event to event queue
+		outQueue.Push(std::move(frame));
+	}
+	catch(const std::exception&)
 	{
-		std::lock_guard<std::mutex> lock(recQueue.m_mutex);
-		recQueue.m_receiptQueue.push_back(std::move(list));
+		// tear down the subscription
+		outQueue.Close();
+		throw;
 	}
-
-	// 3. Debug message
-	logger.Debug(
-		"Emit an event at block #" + std::to_string(headerMgr.GetNumber())
-	);
 }
 
 
-inline EclipseMonitor::Eth::EventDescription
-BuildSubscribedEventDescr(
-	const EclipseMonitor::Eth::ContractAddr& contAddr,
-	const std::vector<EclipseMonitor::Eth::EventTopic>& notifyEvTopics,
-	std::shared_ptr<ThreadedReceiptQueue> receiptQueue
+template<typename _FixedBytesType, typename _BytesObjType>
+inline _FixedBytesType ParseFixedBytes(
+	const _BytesObjType& bytesObj,
+	const std::string& name
 )
 {
-	std::shared_ptr<DecentEnclave::Common::Logger> logger =
-		std::make_shared<DecentEnclave::Common::Logger>(
-			DecentEnclave::Common::LoggerFactory::GetLogger(
-				std::string("Receipt from ") +
-					SimpleObjects::Codec::Hex::
-						Encode<std::string>(contAddr)
+	_FixedBytesType res;
+	if (bytesObj.size() != res.size())
+	{
+		throw std::invalid_argument(
+			"The length of the given " + name + " is invalid"
+		);
+	}
+	std::copy(bytesObj.begin(), bytesObj.end(), res.begin());
+	return res;
+}
+
+
+/**
+ * @brief Parse the receipt filter in a Receipt.Subscribe request;
+ *        the contracts are given either as a single "contract", or as a
+ *        list of "contracts";
+ *        the optional "topics" is a list of positions, where each position
+ *        is either a topic, or a list of topics that are OR-ed together;
+ *        an empty list at a position is a wildcard
+ *
+ * @exception std::invalid_argument if the filter is invalid, or too large
+ *            to be indexed
+ */
+template<typename _DictType>
+inline ReceiptFilter ParseReceiptFilter(const _DictType& msgContentDict)
+{
+	static const SimpleObjects::String sk_labelContract("contract");
+	static const SimpleObjects::String sk_labelContracts("contracts");
+	static const SimpleObjects::String sk_labelTopics("topics");
+
+	// max number of contracts in one filter
+	static constexpr size_t sk_maxContracts = 64;
+	// max number of (contract, topic combination) paths a filter may add
+	// to the index of the dispatcher
+	static constexpr uint64_t sk_maxIndexPaths = 1024;
+
+	using EclipseMonitor::Eth::ContractAddr;
+	using EclipseMonitor::Eth::EventTopic;
+
+	ReceiptFilter filter;
+
+	// 1. get the addresses of the contracts
+	if (msgContentDict.HasKey(sk_labelContracts))
+	{
+		const auto& addrList = msgContentDict[sk_labelContracts].AsList();
+		if ((addrList.size() == 0) || (addrList.size() > sk_maxContracts))
+		{
+			throw std::invalid_argument(
+				"Invalid number of contracts " +
+				std::to_string(addrList.size())
+			);
+		}
+		for (const auto& addrObj : addrList)
+		{
+			filter.m_contractAddrs.push_back(ParseFixedBytes<ContractAddr>(
+				addrObj.AsBytes(),
+				"contract address"
+			));
+		}
+	}
+	else
+	{
+		filter.m_contractAddrs.push_back(
+			ParseFixedBytes<ContractAddr>(
+				msgContentDict[sk_labelContract].AsBytes(),
+				"contract address"
 			)
 		);
+	}
 
-	EclipseMonitor::Eth::EventDescription eventDesc(
-		contAddr,
-		notifyEvTopics,
-		[receiptQueue, logger](
-			const EclipseMonitor::Eth::HeaderMgr& headerMgr,
-			const EclipseMonitor::Eth::ReceiptLogEntry& log,
-			EclipseMonitor::Eth::EventCallbackId
-		) -> void
+	// 2. get the topics at each position
+	if (msgContentDict.HasKey(sk_labelTopics))
+	{
+		const auto& posList = msgContentDict[sk_labelTopics].AsList();
+		if (posList.size() > ReceiptFilter::sk_maxTopicSets)
 		{
-			SubscribedReceiptHandler(*receiptQueue, *logger, headerMgr, log);
+			throw std::invalid_argument(
+				"Invalid number of topic positions " +
+				std::to_string(posList.size())
+			);
 		}
-	);
+		for (const auto& posObj : posList)
+		{
+			TopicSet topicSet;
+			if (posObj.GetCategory() == SimpleObjects::ObjCategory::Bytes)
+			{
+				topicSet.push_back(
+					ParseFixedBytes<EventTopic>(posObj.AsBytes(), "topic")
+				);
+			}
+			else
+			{
+				for (const auto& topicObj : posObj.AsList())
+				{
+					topicSet.push_back(
+						ParseFixedBytes<EventTopic>(topicObj.AsBytes(), "topic")
+					);
+				}
+			}
+			filter.m_topicSets.push_back(std::move(topicSet));
+		}
+	}
+
+	filter.Normalize();
 
-	return eventDesc;
+	// 3. bound the size of the filter in the index
+	uint64_t numPaths = filter.m_contractAddrs.size();
+	for (const auto& topicSet : filter.m_topicSets)
+	{
+		numPaths *= std::max<size_t>(topicSet.size(), 1);
+		if (numPaths > sk_maxIndexPaths)
+		{
+			throw std::invalid_argument("The given filter is too large");
+		}
+	}
+
+	return filter;
 }
 
 
-template<typename _NetConfig>
-inline void SubscribedReceiptEmitter(
-	LambdaMsgSocket& socket,
-	ThreadedReceiptQueue& recQueue,
-	BlockchainMgr<_NetConfig>& bcMgr,
-	EclipseMonitor::Eth::EventCallbackId listenId
-)
+/**
+ * @brief Parse the receipt view in a Receipt.Subscribe request;
+ *        the optional "projection" is a dict of the optional fields:
+ *        "blkNumOnly" (non-zero to receive the block numbers only),
+ *        "topics" (the list of the positions of the topics to receive),
+ *        "dataBegin" and "dataSize" (the byte range of the data to
+ *        receive);
+ *        the optional "dataPrefix" is a prefix, or a list of prefixes, of
+ *        which the log data must start with any
+ *
+ * @exception std::invalid_argument if the view is invalid
+ */
+template<typename _DictType>
+inline ReceiptView ParseReceiptView(const _DictType& msgContentDict)
 {
-	static const SimpleObjects::String sk_labelSecState("SecState");
-	static const SimpleObjects::String sk_labelLatestBlkNum("LatestBlkNum");
-	static const SimpleObjects::String sk_labelReceipts("Receipts");
+	static const SimpleObjects::String sk_labelProjection("projection");
+	static const SimpleObjects::String sk_labelBlkNumOnly("blkNumOnly");
+	static const SimpleObjects::String sk_labelTopics("topics");
+	static const SimpleObjects::String sk_labelDataBegin("dataBegin");
+	static const SimpleObjects::String sk_labelDataSize("dataSize");
+	static const SimpleObjects::String sk_labelDataPrefix("dataPrefix");
 
-	try
+	// max number of data prefixes in one view
+	static constexpr size_t sk_maxDataPrefixes = 16;
+	// max size of a data prefix
+	static constexpr size_t sk_maxDataPrefixSize = 256;
+
+	ReceiptView view;
+
+	// 1. get the projection
+	if (msgContentDict.HasKey(sk_labelProjection))
 	{
-		ReceiptQueue outQueue;
+		const auto& projDict = msgContentDict[sk_labelProjection].AsDict();
+		if (projDict.HasKey(sk_labelBlkNumOnly))
 		{
-			std::lock_guard<std::mutex> lock(recQueue.m_mutex);
-			outQueue = std::move(recQueue.m_receiptQueue);
-			recQueue.m_receiptQueue = ReceiptQueue();
+			view.m_isBlkNumOnly =
+				(projDict[sk_labelBlkNumOnly].AsCppUInt64() != 0);
+		}
+		if (projDict.HasKey(sk_labelTopics))
+		{
+			const auto& idxList = projDict[sk_labelTopics].AsList();
+			if (idxList.size() > ReceiptFilter::sk_maxTopicSets)
+			{
+				throw std::invalid_argument(
+					"Invalid number of projected topics " +
+					std::to_string(idxList.size())
+				);
+			}
+			view.m_isAllTopics = false;
+			for (const auto& idxObj : idxList)
+			{
+				const uint64_t idx = idxObj.AsCppUInt64();
+				if (idx >= ReceiptFilter::sk_maxTopicSets)
+				{
+					throw std::invalid_argument(
+						"Invalid position of projected topic " +
+						std::to_string(idx)
+					);
+				}
+				view.m_topicIdxs.push_back(static_cast<uint8_t>(idx));
+			}
+		}
+		if (projDict.HasKey(sk_labelDataBegin))
+		{
+			view.m_dataBegin = projDict[sk_labelDataBegin].AsCppUInt64();
+		}
+		if (projDict.HasKey(sk_labelDataSize))
+		{
+			view.m_dataSize = projDict[sk_labelDataSize].AsCppUInt64();
 		}
+	}
 
-		auto secState = SimpleObjects::Bytes(AdvancedRlp::GenericWriter::Write(
-			bcMgr.GetMonitorSecState()
-		));
-		auto latestBlkNum = bcMgr.GetLastValidatedBlkNum();
+	// 2. get the predicates
+	if (msgContentDict.HasKey(sk_labelDataPrefix))
+	{
+		const auto& prefixObj = msgContentDict[sk_labelDataPrefix];
+		if (prefixObj.GetCategory() == SimpleObjects::ObjCategory::Bytes)
+		{
+			const auto& prefix = prefixObj.AsBytes();
+			view.m_dataPrefixes.emplace_back(prefix.begin(), prefix.end());
+		}
+		else
+		{
+			const auto& prefixList = prefixObj.AsList();
+			if (prefixList.size() > sk_maxDataPrefixes)
+			{
+				throw std::invalid_argument(
+					"Invalid number of data prefixes " +
+					std::to_string(prefixList.size())
+				);
+			}
+			for (const auto& prefixItemObj : prefixList)
+			{
+				const auto& prefix = prefixItemObj.AsBytes();
+				view.m_dataPrefixes.emplace_back(prefix.begin(), prefix.end());
+			}
+		}
 
-		SimpleObjects::Dict respDict;
-		respDict[sk_labelSecState] = std::move(secState);
-		respDict[sk_labelLatestBlkNum] = std::move(latestBlkNum);
-		respDict[sk_labelReceipts] = std::move(outQueue);
+		for (const auto& prefix : view.m_dataPrefixes)
+		{
+			if (prefix.size() > sk_maxDataPrefixSize)
+			{
+				throw std::invalid_argument(
+					"The given data prefix is too long"
+				);
+			}
+		}
+	}
 
-		std::vector<uint8_t> respMsg =
-			AdvancedRlp::GenericWriter::Write(respDict);
+	view.Normalize();
 
-		socket.SizedSendBytes(respMsg);
-	}
-	catch(const std::exception&)
-	{
-		bcMgr.GetEventManager().Cancel(listenId);
-		throw;
-	}
+	return view;
 }
 
 
@@ -160,59 +381,88 @@ inline void ReceiptSubReq(
 
 	static Logger s_logger =
 		LoggerFactory::GetLogger("DecentEthereum::Trusted::ReceiptSubReq");
-	static const SimpleObjects::String sk_labelContract("contract");
-	static const SimpleObjects::String sk_labelTopics("topics");
 
-	// 1. get the address of the contract
+	// 1. get the filter, and the view of the matched logs
 	auto msgContent = AdvancedRlp::Parse(msgContentAdvRlp);
-	const auto& msgContentDict = msgContent.AsDict();
-	const auto& conAddrObjBase = msgContentDict[sk_labelContract].AsBytes();
-	EclipseMonitor::Eth::ContractAddr conAddr;
-	if (conAddrObjBase.size() != conAddr.size())
+	ReceiptFilter filter;
+	ReceiptView view;
+	try
 	{
-		s_logger.Error("The length of the given contract address is invalid");
-		return;
+		filter = ParseReceiptFilter(msgContent.AsDict());
+		view = ParseReceiptView(msgContent.AsDict());
 	}
-	std::copy(conAddrObjBase.begin(), conAddrObjBase.end(), conAddr.begin());
-
-	// 2. get the topics
-	const auto& topicsObjBase = msgContentDict[sk_labelTopics].AsList();
-	std::vector<EclipseMonitor::Eth::EventTopic> topics;
-	topics.reserve(topicsObjBase.size());
-	for (const auto& topicObjBase : topicsObjBase)
+	catch (const std::invalid_argument& e)
 	{
-		const auto& topicObj = topicObjBase.AsBytes();
-		if (topicObj.size() != std::tuple_size<EclipseMonitor::Eth::EventTopic>::value)
-		{
-			s_logger.Error("The length of the given topic is invalid");
-			return;
-		}
-		EclipseMonitor::Eth::EventTopic topic;
-		std::copy(topicObj.begin(), topicObj.end(), topic.begin());
-		topics.push_back(topic);
+		s_logger.Error(e.what());
+		return;
 	}
 
-	// 3. subscribe to receipt
-	s_logger.Debug("Subscribing to receipts from contract @" +
-		SimpleObjects::Codec::Hex::Encode<std::string>(conAddr)
+	// 2. subscribe to receipt
+	s_logger.Debug(
+		"Subscribing to receipts from " +
+		std::to_string(filter.m_contractAddrs.size()) +
+		" contract(s), first @" +
+		SimpleObjects::Codec::Hex::Encode<std::string>(
+			filter.m_contractAddrs[0]
+		)
 	);
 	std::shared_ptr<ThreadedReceiptQueue> receiptQueue =
 		std::make_shared<ThreadedReceiptQueue>();
-	auto listenId = bcMgrPtr->GetEventManager().Listen(
-		BuildSubscribedEventDescr(
-			conAddr,
-			topics,
+	ReceiptListenerGroups::GroupPtr group =
+		bcMgrPtr->GetReceiptListenerGroups().Join(
+			std::move(filter),
+			std::move(view),
 			receiptQueue
-		)
-	);
+		);
 
-	// 4. set up heartbeat emitter
-	std::shared_ptr<LambdaMsgSocket> ownedSocket = std::move(socket);
+	// 3. set up heartbeat emitter
+	std::shared_ptr<OutboundQueue> outQueue =
+		std::make_shared<OutboundQueue>(std::move(socket));
+	std::shared_ptr<SubscriptionCounter::Token> subToken =
+		bcMgrPtr->GetReceiptSubCounter().MakeToken();
+
+	std::shared_ptr<PushTarget> pushTarget = std::make_shared<PushTarget>(
+		[outQueue, receiptQueue, bcMgrPtr, subToken]()
+		{
+			SubscribedReceiptEmitter(*outQueue, *receiptQueue, *bcMgrPtr);
+		}
+	);
+	receiptQueue->m_pushTrigger->AddTarget(pushTarget);
+
+	std::shared_ptr<SubscriptionSlot> slot =
+		std::make_shared<SubscriptionSlot>(std::move(pushTarget));
+
+	// 4. tear down the subscription once the subscriber is disconnected;
+	//    the listener group is left (and its listener is cancelled if it's
+	//    the last one), the queued receipts are dropped, and the rest of
+	//    the subscription is released with the slot
+	std::weak_ptr<SubscriptionSlot> weakSlot = slot;
+	std::weak_ptr<ThreadedReceiptQueue> weakRecQueue = receiptQueue;
+	outQueue->SetCloseCallback(
+		[weakSlot, weakRecQueue, bcMgrPtr, group]()
+		{
+			std::shared_ptr<ThreadedReceiptQueue> recQueue =
+				weakRecQueue.lock();
+			bcMgrPtr->GetReceiptListenerGroups().Leave(group, recQueue.get());
+
+			if (recQueue != nullptr)
+			{
+				std::lock_guard<std::mutex> lock(recQueue->m_mutex);
+				recQueue->m_receiptQueue = ReceiptQueue();
+			}
+
+			std::shared_ptr<SubscriptionSlot> slot = weakSlot.lock();
+			if (slot != nullptr)
+			{
+				slot->Close();
+			}
+		}
+	);
 
 	HeartbeatEmitterMgr::GetInstance().AddEmitter(
-		[ownedSocket, receiptQueue, bcMgrPtr, listenId]()
+		[slot]()
 		{
-			SubscribedReceiptEmitter(*ownedSocket, *receiptQueue, *bcMgrPtr, listenId);
+			slot->Emit();
 		}
 	);
 
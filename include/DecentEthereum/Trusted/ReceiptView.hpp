@@ -0,0 +1,191 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include <EclipseMonitor/Eth/HeaderMgr.hpp>
+#include <SimpleObjects/SimpleObjects.hpp>
+
+#include "ReceiptLog.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief A receipt log ready to be emitted, i.e., [blkNum, topics, data],
+ *        or [blkNum] only;
+ *        it's immutable once built, so it's shared by all the queues it's
+ *        pushed to
+ *
+ */
+using ReceiptRecord    = SimpleObjects::List;
+using ReceiptRecordPtr = std::shared_ptr<const ReceiptRecord>;
+
+
+/**
+ * @brief What a Receipt.Subscribe subscriber wants to receive for each
+ *        matched log, evaluated in the enclave, so the parts of the logs
+ *        that are not needed are neither kept in the queues nor sent:
+ *        - predicates on the log data: the log is only emitted if its data
+ *          starts with any of the given prefixes (if any is given)
+ *        - projection: only the block number; or the selected topics (by
+ *          position, an empty topic is given for positions the log
+ *          doesn't have) and a byte range of the data
+ *
+ */
+struct ReceiptView
+{
+	static constexpr uint64_t sk_toDataEnd =
+		std::numeric_limits<uint64_t>::max();
+
+	ReceiptView() :
+		m_isBlkNumOnly(false),
+		m_isAllTopics(true),
+		m_topicIdxs(),
+		m_dataBegin(0),
+		m_dataSize(sk_toDataEnd),
+		m_dataPrefixes()
+	{}
+
+	/**
+	 * @brief Sort the data prefixes and remove the duplicates in them, so
+	 *        identical views can be grouped together
+	 *
+	 */
+	void Normalize()
+	{
+		std::sort(m_dataPrefixes.begin(), m_dataPrefixes.end());
+		m_dataPrefixes.erase(
+			std::unique(m_dataPrefixes.begin(), m_dataPrefixes.end()),
+			m_dataPrefixes.end()
+		);
+	}
+
+	bool IsMatch(const ReceiptLog& log) const
+	{
+		if (m_dataPrefixes.empty())
+		{
+			return true;
+		}
+		for (const auto& prefix : m_dataPrefixes)
+		{
+			if (
+				(prefix.size() <= log.m_logData.size()) &&
+				std::equal(prefix.begin(), prefix.end(), log.m_logData.begin())
+			)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	ReceiptRecordPtr BuildRecord(
+		const EclipseMonitor::Eth::HeaderMgr& headerMgr,
+		const ReceiptLog& log
+	) const
+	{
+		std::shared_ptr<ReceiptRecord> record =
+			std::make_shared<ReceiptRecord>();
+		record->reserve(m_isBlkNumOnly ? 1 : 3);
+		record->push_back(
+			SimpleObjects::Bytes(headerMgr.GetRawHeader().get_Number())
+		);
+		if (m_isBlkNumOnly)
+		{
+			return record;
+		}
+
+		SimpleObjects::List topics;
+		if (m_isAllTopics)
+		{
+			topics.reserve(log.m_topics.size());
+			for (const auto& topic : log.m_topics)
+			{
+				topics.push_back(SimpleObjects::Bytes(
+					std::vector<uint8_t>(topic.begin(), topic.end())
+				));
+			}
+		}
+		else
+		{
+			topics.reserve(m_topicIdxs.size());
+			for (const auto& idx : m_topicIdxs)
+			{
+				if (idx < log.m_topics.size())
+				{
+					const auto& topic = log.m_topics[idx];
+					topics.push_back(SimpleObjects::Bytes(
+						std::vector<uint8_t>(topic.begin(), topic.end())
+					));
+				}
+				else
+				{
+					topics.push_back(SimpleObjects::Bytes());
+				}
+			}
+		}
+
+		const size_t dataSize = log.m_logData.size();
+		const size_t begin = static_cast<size_t>(
+			std::min<uint64_t>(m_dataBegin, dataSize)
+		);
+		const size_t end = static_cast<size_t>(
+			std::min<uint64_t>(dataSize - begin, m_dataSize) + begin
+		);
+
+		record->push_back(std::move(topics));
+		record->push_back(SimpleObjects::Bytes(std::vector<uint8_t>(
+			log.m_logData.begin() + begin,
+			log.m_logData.begin() + end
+		)));
+
+		return record;
+	}
+
+	bool operator<(const ReceiptView& other) const
+	{
+		return std::tie(
+				m_isBlkNumOnly,
+				m_isAllTopics,
+				m_topicIdxs,
+				m_dataBegin,
+				m_dataSize,
+				m_dataPrefixes
+			) < std::tie(
+				other.m_isBlkNumOnly,
+				other.m_isAllTopics,
+				other.m_topicIdxs,
+				other.m_dataBegin,
+				other.m_dataSize,
+				other.m_dataPrefixes
+			);
+	}
+
+	bool                               m_isBlkNumOnly;
+	bool                               m_isAllTopics;
+	std::vector<uint8_t>               m_topicIdxs;
+	uint64_t                           m_dataBegin;
+	uint64_t                           m_dataSize;
+	std::vector<std::vector<uint8_t> > m_dataPrefixes;
+}; // struct ReceiptView
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
@@ -0,0 +1,93 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include <DecentEnclave/Common/Sgx/Exceptions.hpp>
+
+#include "Sealing.hpp"
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_store_checkpoint(
+	sgx_status_t*  retval,
+	void*          host_chkpt_store,
+	const uint8_t* in_chkpt,
+	size_t         in_chkpt_size
+);
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief The label bound to the sealed checkpoint as additional MAC text,
+ *        so other sealed data, or the checkpoint of another chain, can't be
+ *        passed in as the checkpoint of the given chain
+ *
+ */
+inline std::string GetCheckpointSealLabel(const std::string& chainName)
+{
+	return "DecentEthereum::Checkpoint::" + chainName;
+}
+
+
+/**
+ * @brief Seal the given checkpoint; the sealing key is bound to the
+ *        enclave identity (MRENCLAVE), so only the same enclave build is
+ *        able to resume from it
+ *
+ */
+inline std::vector<uint8_t> SealCheckpoint(
+	const std::vector<uint8_t>& chkpt,
+	const std::string& chainName
+)
+{
+	return SealData(chkpt, GetCheckpointSealLabel(chainName));
+}
+
+
+/**
+ * @brief Unseal a checkpoint that was sealed by SealCheckpoint
+ *
+ */
+inline std::vector<uint8_t> UnsealCheckpoint(
+	const std::vector<uint8_t>& sealed,
+	const std::string& chainName
+)
+{
+	return UnsealData(sealed, GetCheckpointSealLabel(chainName));
+}
+
+
+/**
+ * @brief Pass the sealed checkpoint to the host, which is responsible for
+ *        storing it on disk
+ *
+ */
+inline void StoreCheckpoint(
+	void* hostChkptStore,
+	const std::vector<uint8_t>& sealed
+)
+{
+	DECENTENCLAVE_SGX_OCALL_CHECK_ERROR_E_R(
+		ocall_decent_ethereum_store_checkpoint,
+		hostChkptStore,
+		sealed.data(),
+		sealed.size()
+	);
+}
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
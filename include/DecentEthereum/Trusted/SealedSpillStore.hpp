@@ -0,0 +1,189 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <DecentEnclave/Common/Sgx/Exceptions.hpp>
+#include <DecentEnclave/Trusted/Sgx/UntrustedBuffer.hpp>
+#include <SimpleObjects/Codec/Hex.hpp>
+
+#include "RandomGenerator.hpp"
+#include "Sealing.hpp"
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_store(
+	sgx_status_t*  retval,
+	void*          host_spill_store,
+	uint64_t       key,
+	const uint8_t* in_data,
+	size_t         in_data_size
+);
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_load(
+	sgx_status_t* retval,
+	void*         host_spill_store,
+	uint64_t      key,
+	uint8_t**     out_buf,
+	size_t*       out_buf_size
+);
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_remove(
+	sgx_status_t* retval,
+	void*         host_spill_store,
+	uint64_t      key
+);
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief Keeps data that doesn't need to stay in the enclave memory at
+ *        the host, sealed;
+ *        Every piece of data is sealed with a label made of the chain name,
+ *        a nonce picked at startup, and the key of the data, so the host
+ *        can neither hand back a different piece of data, nor the data
+ *        stored by an earlier run of the enclave, unless the enclave asks
+ *        for it explicitly (i.e., with the label prefix of that run, which
+ *        is only known from a sealed checkpoint)
+ *
+ */
+class SealedSpillStore
+{
+public:
+
+	SealedSpillStore(void* hostSpillStore, const std::string& chainName) :
+		m_ptr(hostSpillStore),
+		m_labelPrefix(),
+		m_nextKey(0)
+	{
+		std::array<uint8_t, 16> nonce;
+		RandomGenerator().GenerateRandomBytes(nonce.data(), nonce.size());
+
+		m_labelPrefix =
+			"DecentEthereum::Spill::" + chainName + "::" +
+			SimpleObjects::Codec::Hex::Encode<std::string>(nonce) + "::";
+	}
+
+	~SealedSpillStore() = default;
+
+	/**
+	 * @brief Seal the given data and pass it to the host
+	 *
+	 * @return The key used to load the data back
+	 */
+	uint64_t Store(const std::vector<uint8_t>& data)
+	{
+		const uint64_t key = m_nextKey++;
+		const std::vector<uint8_t> sealed = SealData(data, GetLabel(key));
+
+		DECENTENCLAVE_SGX_OCALL_CHECK_ERROR_E_R(
+			ocall_decent_ethereum_spill_store,
+			m_ptr,
+			key,
+			sealed.data(),
+			sealed.size()
+		);
+
+		return key;
+	}
+
+	/**
+	 * @brief Load the data stored under the given key back from the host
+	 *
+	 */
+	std::vector<uint8_t> Load(uint64_t key) const
+	{
+		return Load(key, m_labelPrefix);
+	}
+
+	/**
+	 * @brief Load the data stored under the given key by an earlier run of
+	 *        the enclave, whose label prefix is given
+	 *
+	 */
+	std::vector<uint8_t> Load(
+		uint64_t key,
+		const std::string& labelPrefix
+	) const
+	{
+		DecentEnclave::Trusted::Sgx::UntrustedBuffer<uint8_t> ub;
+		DECENTENCLAVE_SGX_OCALL_CHECK_ERROR_E_R(
+			ocall_decent_ethereum_spill_load,
+			m_ptr,
+			key,
+			&(ub.m_data),
+			&(ub.m_size)
+		);
+
+		return UnsealData(
+			ub.CopyToContainer<std::vector<uint8_t> >(),
+			labelPrefix + std::to_string(key)
+		);
+	}
+
+	/**
+	 * @brief Let the host know the data stored under the given key is no
+	 *        longer needed
+	 *
+	 */
+	void Remove(uint64_t key)
+	{
+		DECENTENCLAVE_SGX_OCALL_CHECK_ERROR_E_R(
+			ocall_decent_ethereum_spill_remove,
+			m_ptr,
+			key
+		);
+	}
+
+	const std::string& GetLabelPrefix() const
+	{
+		return m_labelPrefix;
+	}
+
+	/**
+	 * @brief Make sure the keys given from now on are not less than the
+	 *        given one, so the data stored by an earlier run, which is still
+	 *        needed, is not overwritten at the host
+	 *
+	 */
+	void ReserveKeys(uint64_t nextKey)
+	{
+		uint64_t currKey = m_nextKey.load();
+		while (
+			(currKey < nextKey) &&
+			!m_nextKey.compare_exchange_weak(currKey, nextKey)
+		)
+		{}
+	}
+
+private: // helper functions:
+
+	std::string GetLabel(uint64_t key) const
+	{
+		return m_labelPrefix + std::to_string(key);
+	}
+
+private:
+
+	void* m_ptr;
+	std::string m_labelPrefix;
+	std::atomic<uint64_t> m_nextKey;
+}; // class SealedSpillStore
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
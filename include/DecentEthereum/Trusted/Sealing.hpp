@@ -0,0 +1,133 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sgx_tseal.h>
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief Seal the given data; the sealing key is bound to the enclave
+ *        identity (MRENCLAVE), so only the same enclave build is able to
+ *        unseal it
+ *
+ * @param label The label bound to the sealed data as additional MAC text,
+ *              so the sealed data can't be passed in as something else
+ */
+inline std::vector<uint8_t> SealData(
+	const std::vector<uint8_t>& data,
+	const std::string& label
+)
+{
+	const uint32_t sealedSize = sgx_calc_sealed_data_size(
+		static_cast<uint32_t>(label.size()),
+		static_cast<uint32_t>(data.size())
+	);
+	if (sealedSize == UINT32_MAX)
+	{
+		throw std::runtime_error("The data is too large to be sealed");
+	}
+
+	sgx_attributes_t attrMask;
+	attrMask.flags = TSEAL_DEFAULT_FLAGSMASK;
+	attrMask.xfrm = 0;
+
+	std::vector<uint8_t> sealed(sealedSize);
+	sgx_status_t sgxRet = sgx_seal_data_ex(
+		SGX_KEYPOLICY_MRENCLAVE,
+		attrMask,
+		TSEAL_DEFAULT_MISCMASK,
+		static_cast<uint32_t>(label.size()),
+		reinterpret_cast<const uint8_t*>(label.data()),
+		static_cast<uint32_t>(data.size()),
+		data.data(),
+		sealedSize,
+		reinterpret_cast<sgx_sealed_data_t*>(sealed.data())
+	);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw std::runtime_error(
+			"Failed to seal the data (SGX error " +
+			std::to_string(sgxRet) + ")"
+		);
+	}
+
+	return sealed;
+}
+
+
+/**
+ * @brief Unseal the data that was sealed by SealData
+ *
+ * @param label The label the data is expected to be sealed with
+ */
+inline std::vector<uint8_t> UnsealData(
+	const std::vector<uint8_t>& sealed,
+	const std::string& label
+)
+{
+	if (sealed.size() < sizeof(sgx_sealed_data_t))
+	{
+		throw std::runtime_error("The sealed data is truncated");
+	}
+	const sgx_sealed_data_t* sealedData =
+		reinterpret_cast<const sgx_sealed_data_t*>(sealed.data());
+
+	uint32_t labelSize = sgx_get_add_mac_txt_len(sealedData);
+	uint32_t dataSize = sgx_get_encrypt_txt_len(sealedData);
+	if (
+		(labelSize == UINT32_MAX) ||
+		(dataSize == UINT32_MAX) ||
+		(sgx_calc_sealed_data_size(labelSize, dataSize) != sealed.size())
+	)
+	{
+		throw std::runtime_error("The sealed data is malformed");
+	}
+
+	std::vector<uint8_t> sealedLabel(labelSize);
+	std::vector<uint8_t> data(dataSize);
+	sgx_status_t sgxRet = sgx_unseal_data(
+		sealedData,
+		sealedLabel.data(),
+		&labelSize,
+		data.data(),
+		&dataSize
+	);
+	if (sgxRet != SGX_SUCCESS)
+	{
+		throw std::runtime_error(
+			"Failed to unseal the data (SGX error " +
+			std::to_string(sgxRet) + ")"
+		);
+	}
+
+	if (
+		(sealedLabel.size() != label.size()) ||
+		!std::equal(sealedLabel.begin(), sealedLabel.end(), label.begin())
+	)
+	{
+		throw std::runtime_error("The sealed data is not " + label);
+	}
+
+	return data;
+}
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
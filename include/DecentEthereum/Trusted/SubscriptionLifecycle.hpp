@@ -0,0 +1,139 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "PushNotifier.hpp"
+
+
+namespace DecentEthereum
+{
+namespace Trusted
+{
+
+
+/**
+ * @brief Counts the subscriptions that are alive, i.e., whose state
+ *        (socket, queues, cursors, etc.) is still held in memory
+ *
+ */
+class SubscriptionCounter :
+	public std::enable_shared_from_this<SubscriptionCounter>
+{
+public:
+
+	/**
+	 * @brief Held by a subscription for as long as its state is alive
+	 *
+	 */
+	class Token
+	{
+	public:
+
+		Token(std::shared_ptr<SubscriptionCounter> counter) :
+			m_counter(std::move(counter))
+		{
+			++(m_counter->m_numLive);
+		}
+
+		Token(const Token&) = delete;
+
+		~Token()
+		{
+			--(m_counter->m_numLive);
+		}
+
+	private:
+		std::shared_ptr<SubscriptionCounter> m_counter;
+	}; // class Token
+
+public:
+
+	SubscriptionCounter() :
+		m_numLive(0)
+	{}
+
+	~SubscriptionCounter() = default;
+
+	std::shared_ptr<Token> MakeToken()
+	{
+		return std::make_shared<Token>(shared_from_this());
+	}
+
+	uint64_t GetNumLive() const
+	{
+		return m_numLive.load();
+	}
+
+private:
+	std::atomic<uint64_t> m_numLive;
+}; // class SubscriptionCounter
+
+
+/**
+ * @brief The slot through which the heartbeat emitter reaches a
+ *        subscription; closing the slot releases the subscription (and the
+ *        push target, which the push trigger only holds weakly), leaving
+ *        only the empty slot in the heartbeat emitter
+ *
+ */
+class SubscriptionSlot
+{
+public:
+
+	SubscriptionSlot(std::shared_ptr<PushTarget> target) :
+		m_mutex(),
+		m_target(std::move(target))
+	{}
+
+	~SubscriptionSlot() = default;
+
+	/**
+	 * @brief Emit to the subscription
+	 *
+	 * @exception std::runtime_error if the slot has been closed, so the
+	 *            heartbeat emitter can be dropped
+	 */
+	void Emit()
+	{
+		std::shared_ptr<PushTarget> target;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			target = m_target;
+		}
+
+		if (target == nullptr)
+		{
+			throw std::runtime_error("The subscription has been closed");
+		}
+		(*target)();
+	}
+
+	void Close()
+	{
+		std::shared_ptr<PushTarget> target;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			target.swap(m_target);
+		}
+		// the subscription is released here, outside the lock
+	}
+
+private:
+	std::mutex m_mutex;
+	std::shared_ptr<PushTarget> m_target;
+}; // class SubscriptionSlot
+
+
+} // namespace Trusted
+} // namespace DecentEthereum
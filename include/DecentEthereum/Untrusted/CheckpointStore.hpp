@@ -0,0 +1,154 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+#include <cstdio>
+
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <DecentEnclave/Common/Platform/Print.hpp>
+#include <SimpleConcurrency/Threading/TickingTask.hpp>
+
+
+namespace DecentEthereum
+{
+namespace Untrusted
+{
+
+
+/**
+ * @brief Stores the sealed checkpoint of the enclave on disk
+ *
+ */
+class CheckpointStore
+{
+public:
+
+	CheckpointStore(const std::string& path) :
+		m_path(path)
+	{}
+
+	~CheckpointStore() = default;
+
+	/**
+	 * @brief Load the sealed checkpoint
+	 *
+	 * @return The sealed checkpoint, or an empty vector if there is no
+	 *         checkpoint stored yet
+	 */
+	std::vector<uint8_t> Load() const
+	{
+		std::ifstream file(m_path, std::ios::binary);
+		if (!file)
+		{
+			return std::vector<uint8_t>();
+		}
+
+		return std::vector<uint8_t>(
+			std::istreambuf_iterator<char>(file),
+			std::istreambuf_iterator<char>()
+		);
+	}
+
+	/**
+	 * @brief Save the given sealed checkpoint; it's written to a temporary
+	 *        file first, so the previous checkpoint is kept intact if
+	 *        we fail in the middle
+	 *
+	 */
+	void Save(const std::vector<uint8_t>& sealedChkpt) const
+	{
+		const std::string tmpPath = m_path + ".tmp";
+		{
+			std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+			file.write(
+				reinterpret_cast<const char*>(sealedChkpt.data()),
+				sealedChkpt.size()
+			);
+			if (!file)
+			{
+				throw std::runtime_error(
+					"CheckpointStore - Failed to write to " + tmpPath
+				);
+			}
+		}
+
+		if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0)
+		{
+			throw std::runtime_error(
+				"CheckpointStore - Failed to replace " + m_path
+			);
+		}
+	}
+
+private:
+	std::string m_path;
+}; // class CheckpointStore
+
+
+class CheckpointTask :
+	public SimpleConcurrency::Threading::TickingTask<int64_t>
+{
+public: // static members:
+
+	using Base = SimpleConcurrency::Threading::TickingTask<int64_t>;
+
+	static constexpr int64_t sk_taskUpdIntervalMliSec = 200;
+
+public:
+
+	CheckpointTask(
+		std::function<void()> saveFunc,
+		int64_t updIntervalMliSec
+	) :
+		Base(sk_taskUpdIntervalMliSec, updIntervalMliSec),
+		m_saveFunc(std::move(saveFunc))
+	{}
+
+	virtual ~CheckpointTask() = default;
+
+
+protected:
+
+	virtual void Tick() override
+	{
+		try
+		{
+			m_saveFunc();
+		}
+		catch (const std::exception& e)
+		{
+			// we will try again at the next tick
+			DecentEnclave::Common::Platform::Print::StrErr(
+				std::string("CheckpointTask - Failed to save checkpoint: ") +
+				e.what()
+			);
+		}
+	}
+
+
+	virtual void SleepFor(int64_t mliSec) const override
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(mliSec));
+	}
+
+
+private:
+	std::function<void()> m_saveFunc;
+}; // class CheckpointTask
+
+
+} // namespace Untrusted
+} // namespace DecentEthereum
@@ -0,0 +1,129 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstddef>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <DecentEnclave/Common/Platform/Print.hpp>
+
+
+namespace DecentEthereum
+{
+namespace Untrusted
+{
+
+
+/**
+ * @brief Threads donated to the worker pool inside the enclave;
+ *        each thread enters the enclave via the worker ECall and stays
+ *        there until the workers are stopped
+ *
+ */
+class EnclaveWorkerThreads
+{
+public:
+
+	/**
+	 * @brief Construct a new Enclave Worker Threads object
+	 *
+	 * @tparam _EnclaveType The enclave type, which should provide
+	 *                      RunWorker() and StopWorkers()
+	 * @param enclave    The enclave
+	 * @param numWorkers Number of worker threads; each of them occupies a
+	 *                   TCS slot of the enclave
+	 */
+	template<typename _EnclaveType>
+	EnclaveWorkerThreads(
+		std::shared_ptr<_EnclaveType> enclave,
+		size_t numWorkers
+	) :
+		EnclaveWorkerThreads(
+			[enclave]() { enclave->RunWorker(); },
+			[enclave]() { enclave->StopWorkers(); },
+			numWorkers
+		)
+	{}
+
+	/**
+	 * @brief Construct a new Enclave Worker Threads object for any pool
+	 *        inside the enclave
+	 *
+	 * @param runFunc    The function entering the enclave as a worker
+	 * @param stopFunc   The function stopping all the workers
+	 * @param numWorkers Number of worker threads; each of them occupies a
+	 *                   TCS slot of the enclave
+	 */
+	EnclaveWorkerThreads(
+		std::function<void()> runFunc,
+		std::function<void()> stopFunc,
+		size_t numWorkers
+	) :
+		m_stopFunc(std::move(stopFunc)),
+		m_threads()
+	{
+		m_threads.reserve(numWorkers);
+		for (size_t i = 0; i < numWorkers; ++i)
+		{
+			m_threads.emplace_back(
+				[runFunc]()
+				{
+					try
+					{
+						runFunc();
+					}
+					catch (const std::exception& e)
+					{
+						DecentEnclave::Common::Platform::Print::StrErr(
+							std::string("Enclave worker failed: ") + e.what()
+						);
+					}
+				}
+			);
+		}
+	}
+
+	~EnclaveWorkerThreads()
+	{
+		Stop();
+	}
+
+	void Stop()
+	{
+		if (m_threads.empty())
+		{
+			return;
+		}
+
+		m_stopFunc();
+		for (auto& thread : m_threads)
+		{
+			thread.join();
+		}
+		m_threads.clear();
+	}
+
+	size_t GetNumWorkers() const
+	{
+		return m_threads.size();
+	}
+
+private:
+
+	std::function<void()> m_stopFunc;
+	std::vector<std::thread> m_threads;
+}; // class EnclaveWorkerThreads
+
+
+} // namespace Untrusted
+} // namespace DecentEthereum
@@ -0,0 +1,179 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <DecentEnclave/Common/Platform/Print.hpp>
+#include <SimpleConcurrency/Threading/TickingTask.hpp>
+
+
+namespace DecentEthereum
+{
+namespace Untrusted
+{
+
+
+/**
+ * @brief Armed by the enclave (via an OCall) when events come in after
+ *        the last push tick, so the push tick task only enters the enclave
+ *        when there is something to push
+ *
+ */
+class PushAlarm
+{
+public: // static members:
+
+	static PushAlarm& GetInstance()
+	{
+		static PushAlarm s_inst;
+		return s_inst;
+	}
+
+public:
+
+	PushAlarm() :
+		m_mutex(),
+		m_cond(),
+		m_isArmed(false)
+	{}
+
+	~PushAlarm() = default;
+
+	void Arm()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_isArmed = true;
+		}
+		m_cond.notify_all();
+	}
+
+	/**
+	 * @brief Wait until the alarm is armed, or the given time has passed
+	 *
+	 * @return true if the alarm is armed
+	 */
+	bool WaitFor(int64_t mliSec)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_cond.wait_for(
+			lock,
+			std::chrono::milliseconds(mliSec),
+			[this]() { return m_isArmed; }
+		);
+	}
+
+	/**
+	 * @brief Disarm the alarm
+	 *
+	 * @return true if the alarm was armed
+	 */
+	bool Disarm()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const bool wasArmed = m_isArmed;
+		m_isArmed = false;
+		return wasArmed;
+	}
+
+private:
+
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_isArmed;
+}; // class PushAlarm
+
+
+/**
+ * @brief Drives the push mode of the enclave; it sleeps until the enclave
+ *        arms the push alarm, then waits for one coalescing window, and
+ *        ticks once, so the events that came in within the window are
+ *        pushed to the subscribers together
+ *
+ */
+class PushTickTask :
+	public SimpleConcurrency::Threading::TickingTask<int64_t>
+{
+public: // static members:
+
+	using Base = SimpleConcurrency::Threading::TickingTask<int64_t>;
+
+	/**
+	 * @brief Max time spent waiting for the alarm at once, which bounds
+	 *        how long it takes to notice the task is terminated
+	 *
+	 */
+	static constexpr int64_t sk_taskUpdIntervalMliSec = 200;
+
+public:
+
+	PushTickTask(
+		std::function<void()> tickFunc,
+		int64_t windowMliSec
+	) :
+		Base(sk_taskUpdIntervalMliSec, windowMliSec),
+		m_tickFunc(std::move(tickFunc)),
+		m_windowMliSec(windowMliSec)
+	{}
+
+	virtual ~PushTickTask() = default;
+
+
+protected:
+
+	virtual void Tick() override
+	{
+		if (!PushAlarm::GetInstance().Disarm())
+		{
+			// nothing came in; don't enter the enclave
+			return;
+		}
+
+		try
+		{
+			m_tickFunc();
+		}
+		catch (const std::exception& e)
+		{
+			// events not pushed are still sent by the next heartbeat
+			DecentEnclave::Common::Platform::Print::StrErr(
+				std::string("PushTickTask - Failed to push events: ") +
+				e.what()
+			);
+		}
+	}
+
+
+	virtual void SleepFor(int64_t mliSec) const override
+	{
+		if (PushAlarm::GetInstance().WaitFor(mliSec))
+		{
+			// coalesce the events that follow within the window
+			std::this_thread::sleep_for(
+				std::chrono::milliseconds(m_windowMliSec)
+			);
+		}
+	}
+
+
+private:
+	std::function<void()> m_tickFunc;
+	int64_t m_windowMliSec;
+}; // class PushTickTask
+
+
+} // namespace Untrusted
+} // namespace DecentEthereum
@@ -0,0 +1,95 @@
+// Copyright (c) 2023 Haofan Zheng
+// Use of this source code is governed by an MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT.
+
+#pragma once
+
+
+#include <cstdint>
+#include <cstdio>
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace DecentEthereum
+{
+namespace Untrusted
+{
+
+
+/**
+ * @brief Stores the sealed data spilled by the enclave on disk, one file
+ *        per key; the files are kept when the store is destroyed, since
+ *        the checkpoint of the enclave may refer to them, and the enclave
+ *        removes the ones it no longer needs
+ *
+ */
+class SpillStore
+{
+public:
+
+	/**
+	 * @param pathPrefix The prefix of the path of the files; the key of the
+	 *                   data is appended to it
+	 */
+	SpillStore(const std::string& pathPrefix) :
+		m_pathPrefix(pathPrefix)
+	{}
+
+	~SpillStore() = default;
+
+	void Save(uint64_t key, const uint8_t* data, size_t size)
+	{
+		const std::string path = GetPath(key);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<const char*>(data), size);
+		if (!file)
+		{
+			throw std::runtime_error(
+				"SpillStore - Failed to write to " + path
+			);
+		}
+	}
+
+	std::vector<uint8_t> Load(uint64_t key) const
+	{
+		const std::string path = GetPath(key);
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw std::runtime_error(
+				"SpillStore - Failed to open " + path
+			);
+		}
+
+		return std::vector<uint8_t>(
+			std::istreambuf_iterator<char>(file),
+			std::istreambuf_iterator<char>()
+		);
+	}
+
+	void Remove(uint64_t key)
+	{
+		std::remove(GetPath(key).c_str());
+	}
+
+private: // helper functions:
+
+	std::string GetPath(uint64_t key) const
+	{
+		return m_pathPrefix + std::to_string(key);
+	}
+
+private:
+
+	std::string m_pathPrefix;
+}; // class SpillStore
+
+
+} // namespace Untrusted
+} // namespace DecentEthereum
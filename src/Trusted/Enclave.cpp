@@ -4,6 +4,13 @@
 // https://opensource.org/licenses/MIT.
 
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include <sgx_edger8r.h>
 
 #include <DecentEnclave/Common/Platform/Print.hpp>
@@ -16,8 +23,13 @@
 #include <DecentEnclave/Trusted/Sgx/EnclaveIdentity.hpp>
 
 #include <DecentEthereum/Trusted/BlockchainMgr.hpp>
+#include <DecentEthereum/Trusted/EnclaveWorkerPool.hpp>
+#include <DecentEthereum/Trusted/OutboundQueue.hpp>
 #include <DecentEthereum/Trusted/Pubsub/SubscriberHandler.hpp>
+#include <DecentEthereum/Trusted/PushNotifier.hpp>
 #include <DecentEthereum/Trusted/ReceiptSubscriber.hpp>
+#include <DecentEthereum/Trusted/SealedCheckpoint.hpp>
+#include <DecentEthereum/Trusted/SealedSpillStore.hpp>
 #include <DecentEthereum/Trusted/Transaction.hpp>
 
 #include <EclipseMonitor/MonitorReport.hpp>
@@ -26,15 +38,17 @@
 #include "Keys.hpp"
 
 
-using EthChainConfig = EclipseMonitor::Eth::GoerliConfig;
-
-
 namespace DecentEthereum
 {
 
 
-std::shared_ptr<Trusted::BlockchainMgr<EthChainConfig> >
-	g_blockchainMgr;
+using BlockchainMgrList    =
+	std::vector<std::shared_ptr<Trusted::BlockchainMgrBase> >;
+using BlockchainMgrListPtr = std::shared_ptr<const BlockchainMgrList>;
+
+
+std::mutex           g_blockchainMgrsMutex;
+BlockchainMgrListPtr g_blockchainMgrs;
 
 
 void GlobalInitialization()
@@ -102,44 +116,73 @@ inline void RequestAppCert(const std::string& keyName)
 }
 
 
-inline void HandlePubsubSubReq(
-	DecentEnclave::Trusted::LambdaHandlerMgr::SocketPtrType& socket,
-	const DecentEnclave::Trusted::LambdaHandlerMgr::MsgIdExtType& msgIdExt,
-	const DecentEnclave::Trusted::LambdaHandlerMgr::MsgContentType& msgContent
+/**
+ * @brief Register the lambda handlers of the given chain under
+ *        "<namespace>.<handler>"
+ *
+ * @param isDefault Whether the handlers should also be registered without
+ *                  the namespace, i.e., the names used before multiple
+ *                  chains were supported
+ */
+template<typename _NetConfig>
+inline void RegisterChainHandlers(
+	std::shared_ptr<Trusted::BlockchainMgr<_NetConfig> > bcMgr,
+	bool isDefault
 )
 {
-	Trusted::Pubsub::SubReq(
-		g_blockchainMgr,
-		socket,
-		msgIdExt,
-		msgContent
-	);
-}
+	using namespace DecentEnclave::Trusted;
 
+	std::vector<std::string> prefixes = { bcMgr->GetChainName() + "." };
+	if (isDefault)
+	{
+		prefixes.push_back(std::string());
+	}
 
-inline void HandleReceiptSubReq(
-	DecentEnclave::Trusted::LambdaHandlerMgr::SocketPtrType& socket,
-	const DecentEnclave::Trusted::LambdaHandlerMgr::MsgIdExtType& msgIdExt,
-	const DecentEnclave::Trusted::LambdaHandlerMgr::MsgContentType& msgContent
-)
-{
-	Trusted::ReceiptSubReq(
-		g_blockchainMgr,
-		socket,
-		msgIdExt,
-		msgContent
-	);
+	for (const auto& prefix : prefixes)
+	{
+		LambdaHandlerMgr::GetInstance().RegisterHandler(
+			prefix + "PubSub.Subscribe",
+			[bcMgr](
+				LambdaHandlerMgr::SocketPtrType& socket,
+				const LambdaHandlerMgr::MsgIdExtType& msgIdExt,
+				const LambdaHandlerMgr::MsgContentType& msgContent
+			)
+			{
+				Trusted::Pubsub::SubReq(bcMgr, socket, msgIdExt, msgContent);
+			}
+		);
+		LambdaHandlerMgr::GetInstance().RegisterHandler(
+			prefix + "Receipt.Subscribe",
+			[bcMgr](
+				LambdaHandlerMgr::SocketPtrType& socket,
+				const LambdaHandlerMgr::MsgIdExtType& msgIdExt,
+				const LambdaHandlerMgr::MsgContentType& msgContent
+			)
+			{
+				Trusted::ReceiptSubReq(bcMgr, socket, msgIdExt, msgContent);
+			}
+		);
+		LambdaHandlerMgr::GetInstance().RegisterHandler(
+			prefix + "Transaction.SendRaw",
+			[bcMgr](
+				LambdaHandlerMgr::SocketPtrType& socket,
+				const LambdaHandlerMgr::MsgIdExtType& msgIdExt,
+				const LambdaHandlerMgr::MsgContentType& msgContent
+			)
+			{
+				Trusted::Transaction::SendRaw(
+					bcMgr,
+					socket,
+					msgIdExt,
+					msgContent
+				);
+			}
+		);
+	}
 }
 
 
-void Init(
-	const EclipseMonitor::MonitorConfig& mConf,
-	EclipseMonitor::Eth::BlockNumber startBlkNum,
-	const EclipseMonitor::Eth::ContractAddr& syncContractAddr,
-	const std::string& syncEventSign,
-	const EclipseMonitor::Eth::ContractAddr& pubsubContractAddr,
-	std::unique_ptr<Trusted::HostBlockService> blkSvc
-)
+void Init()
 {
 	using namespace DecentEnclave::Trusted;
 
@@ -149,77 +192,197 @@ void Init(
 	RequestAppCert<DecentCert_Secp256r1>("Secp256r1");
 	RequestAppCert<DecentCert_Secp256k1>("Secp256k1");
 
-	g_blockchainMgr = std::make_shared<Trusted::BlockchainMgr<EthChainConfig> >(
-		mConf,
-		startBlkNum,
-		syncContractAddr,
-		syncEventSign,
-		SimpleObjects::Internal::
-			make_unique<Trusted::Pubsub::SubscriberService>(
-				pubsubContractAddr,
-				"ServiceDeployed(address)",
-				"PublisherRegistered(address,address)",
-				"NotifySubscribers(bytes)"
-		),
-		std::move(blkSvc)
-	);
-
 	LambdaServerConfig lambdaSvrConfig(
 		"Secp256r1",
 		"Secp256r1"
 	);
 	LambdaServerConfig::GetInstance(&lambdaSvrConfig);
+}
 
-	LambdaHandlerMgr::GetInstance().RegisterHandler(
-		"PubSub.Subscribe",
-		HandlePubsubSubReq
-	);
-	LambdaHandlerMgr::GetInstance().RegisterHandler(
-		"Receipt.Subscribe",
-		HandleReceiptSubReq
-	);
-	LambdaHandlerMgr::GetInstance().RegisterHandler(
-		"Transaction.SendRaw",
-		[](
-			DecentEnclave::Trusted::LambdaHandlerMgr::SocketPtrType& socket,
-			const DecentEnclave::Trusted::LambdaHandlerMgr::MsgIdExtType& msgIdExt,
-			const DecentEnclave::Trusted::LambdaHandlerMgr::MsgContentType& msgContent
-		)
+
+/**
+ * @return The ID of the new chain
+ */
+uint64_t RegisterBlockchainMgr(
+	std::shared_ptr<Trusted::BlockchainMgrBase> bcMgr
+)
+{
+	// chains are only added during initialization, so a copy-on-write
+	// list is enough to let the block ingestion of different chains
+	// never share a lock
+	std::lock_guard<std::mutex> lock(g_blockchainMgrsMutex);
+
+	BlockchainMgrListPtr oldList = std::atomic_load(&g_blockchainMgrs);
+	std::shared_ptr<BlockchainMgrList> newList =
+		oldList ?
+			std::make_shared<BlockchainMgrList>(*oldList) :
+			std::make_shared<BlockchainMgrList>();
+
+	for (const auto& existing : *newList)
+	{
+		if (existing->GetChainName() == bcMgr->GetChainName())
 		{
-			Trusted::Transaction::SendRaw(
-				g_blockchainMgr,
-				socket,
-				msgIdExt,
-				msgContent
+			throw std::invalid_argument(
+				"Chain " + bcMgr->GetChainName() + " already exists"
 			);
 		}
-	);
+	}
+
+	const uint64_t chainId = newList->size();
+	newList->push_back(std::move(bcMgr));
+
+	std::atomic_store(&g_blockchainMgrs, BlockchainMgrListPtr(newList));
+
+	return chainId;
+}
+
+
+Trusted::BlockchainMgrBase& GetBlockchainMgr(uint64_t chainId)
+{
+	BlockchainMgrListPtr list = std::atomic_load(&g_blockchainMgrs);
+	if ((list == nullptr) || (chainId >= list->size()))
+	{
+		throw std::out_of_range(
+			"Chain #" + std::to_string(chainId) + " doesn't exist"
+		);
+	}
+	// the manager is never removed once it's added
+	return *((*list)[chainId]);
+}
+
+
+/**
+ * @param startBlkNum The number of the block to start from; it's updated
+ *                    to the block right after the checkpoint, if a
+ *                    checkpoint is given
+ * @return The ID of the new chain
+ */
+template<typename _NetConfig>
+uint64_t AddChain(
+	const std::string& chainName,
+	const EclipseMonitor::MonitorConfig& mConf,
+	EclipseMonitor::Eth::BlockNumber& startBlkNum,
+	const EclipseMonitor::Eth::ContractAddr& syncContractAddr,
+	const std::string& syncEventSign,
+	const EclipseMonitor::Eth::ContractAddr& pubsubContractAddr,
+	const Trusted::Pubsub::EventRetention& retention,
+	const Trusted::Pubsub::EventSpill& spill,
+	std::unique_ptr<Trusted::HostBlockService> blkSvc,
+	const std::vector<uint8_t>& sealedChkpt
+)
+{
+	using BlockchainMgrType = Trusted::BlockchainMgr<_NetConfig>;
+
+	std::unique_ptr<Trusted::Pubsub::SubscriberService> subSvc =
+		SimpleObjects::Internal::
+			make_unique<Trusted::Pubsub::SubscriberService>(
+				pubsubContractAddr,
+				"ServiceDeployed(address)",
+				"PublisherRegistered(address,address)",
+				"NotifySubscribers(bytes)",
+				retention,
+				spill
+		);
+
+	typename BlockchainMgrType::ResumePoint resumePoint;
+	if (!sealedChkpt.empty())
+	{
+		resumePoint = BlockchainMgrType::RestoreCheckpoint(
+			Trusted::UnsealCheckpoint(sealedChkpt, chainName),
+			*subSvc
+		);
+		startBlkNum = std::max(startBlkNum, resumePoint.m_blkNum);
+	}
+
+	std::shared_ptr<BlockchainMgrType> bcMgr =
+		std::make_shared<BlockchainMgrType>(
+			chainName,
+			mConf,
+			startBlkNum,
+			syncContractAddr,
+			syncEventSign,
+			std::move(subSvc),
+			std::move(blkSvc)
+		);
+	if (!sealedChkpt.empty() && (resumePoint.m_blkNum == startBlkNum))
+	{
+		// the chain resumes right after the checkpoint
+		bcMgr->ExpectResumeFrom(resumePoint);
+	}
+
+	const uint64_t chainId = RegisterBlockchainMgr(bcMgr);
+	RegisterChainHandlers(bcMgr, chainId == 0);
+
+	return chainId;
+}
+
+
+void RecvBlock(uint64_t chainId, const std::vector<uint8_t>& hdrRlp)
+{
+	GetBlockchainMgr(chainId).AppendBlock(hdrRlp);
 }
 
 
-void RecvBlock(const std::vector<uint8_t>& hdrRlp)
+void SaveCheckpoint(uint64_t chainId, void* hostChkptStore)
 {
-	g_blockchainMgr->AppendBlock(hdrRlp);
+	auto& bcMgr = GetBlockchainMgr(chainId);
+	auto sealed = Trusted::SealCheckpoint(
+		bcMgr.BuildCheckpoint(),
+		bcMgr.GetChainName()
+	);
+	Trusted::StoreCheckpoint(hostChkptStore, sealed);
 }
 
 
 } // namespace DecentEthereum
 
 
-extern "C" sgx_status_t ecall_decent_ethereum_init(
+extern "C" sgx_status_t ecall_decent_ethereum_init()
+{
+	try
+	{
+		DecentEthereum::Init();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_add_chain(
+	const char* in_chain_name,
+	const char* in_net_name,
 	const uint8_t* in_conf,
 	size_t in_conf_size,
 	uint64_t start_blk_num,
 	const uint8_t* in_sync_addr,
 	const char* in_sync_esign,
 	const uint8_t* in_pubsub_addr,
-	void* host_blk_svc
+	uint64_t retain_max_events,
+	uint64_t retain_max_bytes,
+	uint64_t retain_max_blk_age,
+	void* host_spill_store,
+	uint64_t spill_hot_chunks,
+	uint64_t spill_max_cold_chunks,
+	void* host_blk_svc,
+	const uint8_t* in_chkpt,
+	size_t in_chkpt_size,
+	uint64_t* out_chain_id,
+	uint64_t* out_start_blk_num
 )
 {
 	using namespace DecentEthereum;
 
 	try
 	{
+		std::string chainName(in_chain_name);
+		std::string netName(in_net_name);
+
 		std::vector<uint8_t> mConfAdvRlp(in_conf, in_conf + in_conf_size);
 
 		EclipseMonitor::MonitorConfig mConf =
@@ -241,18 +404,76 @@ extern "C" sgx_status_t ecall_decent_ethereum_init(
 			pubsubContractAddr.begin()
 		);
 
+		Trusted::Pubsub::EventRetention retention(
+			retain_max_events,
+			retain_max_bytes,
+			retain_max_blk_age
+		);
+
+		// spilling is disabled if the host doesn't provide a store
+		Trusted::Pubsub::EventSpill spill;
+		if (host_spill_store != nullptr)
+		{
+			spill = Trusted::Pubsub::EventSpill(
+				std::make_shared<Trusted::SealedSpillStore>(
+					host_spill_store,
+					chainName
+				),
+				spill_hot_chunks,
+				spill_max_cold_chunks
+			);
+		}
+
 		std::unique_ptr<Trusted::HostBlockService> blkSvc =
 			SimpleObjects::Internal::
 				make_unique<Trusted::HostBlockService>(host_blk_svc);
 
-		DecentEthereum::Init(
-			mConf,
-			start_blk_num,
-			syncContractAddr,
-			syncEventSign,
-			pubsubContractAddr,
-			std::move(blkSvc)
-		);
+		std::vector<uint8_t> sealedChkpt(in_chkpt, in_chkpt + in_chkpt_size);
+
+		EclipseMonitor::Eth::BlockNumber startBlkNum = start_blk_num;
+
+		// the network configuration is a compile-time parameter of the
+		// Eclipse Monitor, so all supported networks are listed here
+		if (netName == "Mainnet")
+		{
+			*out_chain_id = DecentEthereum::AddChain<
+				EclipseMonitor::Eth::MainnetConfig
+			>(
+				chainName,
+				mConf,
+				startBlkNum,
+				syncContractAddr,
+				syncEventSign,
+				pubsubContractAddr,
+				retention,
+				spill,
+				std::move(blkSvc),
+				sealedChkpt
+			);
+		}
+		else if (netName == "Goerli")
+		{
+			*out_chain_id = DecentEthereum::AddChain<
+				EclipseMonitor::Eth::GoerliConfig
+			>(
+				chainName,
+				mConf,
+				startBlkNum,
+				syncContractAddr,
+				syncEventSign,
+				pubsubContractAddr,
+				retention,
+				spill,
+				std::move(blkSvc),
+				sealedChkpt
+			);
+		}
+		else
+		{
+			throw std::invalid_argument("Unsupported network " + netName);
+		}
+		*out_start_blk_num = startBlkNum;
+
 		return SGX_SUCCESS;
 	}
 	catch(const std::exception& e)
@@ -265,6 +486,7 @@ extern "C" sgx_status_t ecall_decent_ethereum_init(
 
 
 extern "C" sgx_status_t ecall_decent_ethereum_recv_block(
+	uint64_t chain_id,
 	const uint8_t* hdr_rlp,
 	size_t hdr_size
 )
@@ -272,7 +494,163 @@ extern "C" sgx_status_t ecall_decent_ethereum_recv_block(
 	try
 	{
 		std::vector<uint8_t> hdrRlp(hdr_rlp, hdr_rlp + hdr_size);
-		DecentEthereum::RecvBlock(hdrRlp);
+		DecentEthereum::RecvBlock(chain_id, hdrRlp);
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_seal_checkpoint(
+	uint64_t chain_id,
+	void* host_chkpt_store
+)
+{
+	try
+	{
+		DecentEthereum::SaveCheckpoint(chain_id, host_chkpt_store);
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_worker_run()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetInstance().RunWorker();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_worker_stop()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetInstance().Terminate();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_outbound_worker_run()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetOutboundInstance().
+			RunWorker();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_outbound_worker_stop()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetOutboundInstance().
+			Terminate();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_outbound_spare_worker_run()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetOutboundInstance().
+			RunSpareWorker();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_set_outbound_config(
+	uint64_t queue_capacity,
+	const char* in_overflow_policy,
+	uint64_t max_full_heartbeats,
+	uint64_t send_timeout_sec
+)
+{
+	try
+	{
+		using namespace DecentEthereum::Trusted;
+
+		OutboundQueue::SetDefaultConfig(
+			OutboundQueue::Config(
+				static_cast<size_t>(queue_capacity),
+				OutboundQueue::ParseOverflowPolicy(in_overflow_policy),
+				max_full_heartbeats,
+				send_timeout_sec
+			)
+		);
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_push_tick()
+{
+	try
+	{
+		DecentEthereum::Trusted::PushNotifier::GetInstance().Tick();
 
 		return SGX_SUCCESS;
 	}
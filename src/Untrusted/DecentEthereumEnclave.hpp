@@ -13,25 +13,81 @@
 
 #include <DecentEthereum/Untrusted/BlockReceiver.hpp>
 #include <DecentEthereum/Untrusted/HostBlockService.hpp>
+#include <DecentEthereum/Untrusted/SpillStore.hpp>
 
 
 extern "C" sgx_status_t ecall_decent_ethereum_init(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_add_chain(
 	sgx_enclave_id_t eid,
 	sgx_status_t*    retval,
+	const char*      in_chain_name,
+	const char*      in_net_name,
 	const uint8_t*   in_conf,
 	size_t           in_conf_size,
 	uint64_t         start_blk_num,
 	const uint8_t*   in_sync_addr,
 	const char*      in_sync_esign,
 	const uint8_t*   in_pubsub_addr,
-	void*            host_blk_svc
+	uint64_t         retain_max_events,
+	uint64_t         retain_max_bytes,
+	uint64_t         retain_max_blk_age,
+	void*            host_spill_store,
+	uint64_t         spill_hot_chunks,
+	uint64_t         spill_max_cold_chunks,
+	void*            host_blk_svc,
+	const uint8_t*   in_chkpt,
+	size_t           in_chkpt_size,
+	uint64_t*        out_chain_id,
+	uint64_t*        out_start_blk_num
 );
 extern "C" sgx_status_t ecall_decent_ethereum_recv_block(
 	sgx_enclave_id_t eid,
 	sgx_status_t*    retval,
+	uint64_t         chain_id,
 	const uint8_t*   blk_data,
 	size_t           blk_size
 );
+extern "C" sgx_status_t ecall_decent_ethereum_seal_checkpoint(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval,
+	uint64_t         chain_id,
+	void*            host_chkpt_store
+);
+extern "C" sgx_status_t ecall_decent_ethereum_worker_run(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_worker_stop(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_outbound_worker_run(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_outbound_worker_stop(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_outbound_spare_worker_run(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_set_outbound_config(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval,
+	uint64_t         queue_capacity,
+	const char*      in_overflow_policy,
+	uint64_t         max_full_heartbeats,
+	uint64_t         send_timeout_sec
+);
+extern "C" sgx_status_t ecall_decent_ethereum_push_tick(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
 
 
 namespace DecentEthereum
@@ -41,8 +97,7 @@ namespace Untrusted
 
 
 class DecentEthereumEnclave :
-	public DecentEnclave::Untrusted::Sgx::DecentSgxEnclave,
-	public BlockReceiver
+	public DecentEnclave::Untrusted::Sgx::DecentSgxEnclave
 {
 public: // static members:
 
@@ -53,51 +108,252 @@ public:
 
 
 	DecentEthereumEnclave(
+		const std::vector<uint8_t>& authList,
+		const std::string& enclaveImgPath = DECENT_ENCLAVE_PLATFORM_SGX_IMAGE,
+		const std::string& launchTokenPath = DECENT_ENCLAVE_PLATFORM_SGX_TOKEN
+	) :
+		Base(authList, enclaveImgPath, launchTokenPath),
+		m_hostBlockServices(),
+		m_spillStores()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_init,
+			m_encId
+		);
+	}
+
+
+	/**
+	 * @brief Add a chain to be followed by the enclave
+	 *
+	 * @param chainName   The name of the chain; it's also the namespace of
+	 *                    the lambda handlers of this chain
+	 * @param netName     The name of the network configuration,
+	 *                    e.g., "Mainnet" or "Goerli"
+	 * @param startBlkNum The number of the block to start from
+	 * @param retainMaxEvents, retainMaxBytes, retainMaxBlkAge
+	 *                    The retention policy of the past events of each
+	 *                    event manager; 0 means unlimited
+	 * @param spillStore  The store of the past events spilled by the
+	 *                    enclave; nullptr disables spilling
+	 * @param spillHotChunks, spillMaxColdChunks
+	 *                    The number of chunks of past events kept in the
+	 *                    enclave, and the max number kept in the spill
+	 *                    store (0 means unlimited)
+	 * @param outStartBlkNum The number of the block the enclave expects to
+	 *                    receive first; it's the block after the checkpoint,
+	 *                    if the enclave has resumed from one
+	 * @return The ID of the chain
+	 */
+	uint64_t AddChain(
+		const std::string& chainName,
+		const std::string& netName,
 		const EclipseMonitor::MonitorConfig& mConf,
 		EclipseMonitor::Eth::BlockNumber startBlkNum,
 		const EclipseMonitor::Eth::ContractAddr& syncContractAddr,
 		const std::string& syncEventSign,
 		const EclipseMonitor::Eth::ContractAddr& pubsubContractAddr,
+		uint64_t retainMaxEvents,
+		uint64_t retainMaxBytes,
+		uint64_t retainMaxBlkAge,
+		std::shared_ptr<SpillStore> spillStore,
+		uint64_t spillHotChunks,
+		uint64_t spillMaxColdChunks,
 		std::shared_ptr<HostBlockService> hostBlockService,
-		const std::vector<uint8_t>& authList,
-		const std::string& enclaveImgPath = DECENT_ENCLAVE_PLATFORM_SGX_IMAGE,
-		const std::string& launchTokenPath = DECENT_ENCLAVE_PLATFORM_SGX_TOKEN
-	) :
-		Base(authList, enclaveImgPath, launchTokenPath),
-		m_hostBlockService(hostBlockService)
+		const std::vector<uint8_t>& sealedChkpt,
+		EclipseMonitor::Eth::BlockNumber* outStartBlkNum
+	)
 	{
 		auto mConfAdvRlp = AdvancedRlp::GenericWriter::Write(mConf);
 
+		uint64_t chainId = 0;
 		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
-			ecall_decent_ethereum_init,
+			ecall_decent_ethereum_add_chain,
 			m_encId,
+			chainName.c_str(),
+			netName.c_str(),
 			mConfAdvRlp.data(),
 			mConfAdvRlp.size(),
 			startBlkNum,
 			syncContractAddr.data(),
 			syncEventSign.c_str(),
 			pubsubContractAddr.data(),
-			m_hostBlockService.get()
+			retainMaxEvents,
+			retainMaxBytes,
+			retainMaxBlkAge,
+			spillStore.get(),
+			spillHotChunks,
+			spillMaxColdChunks,
+			hostBlockService.get(),
+			sealedChkpt.data(),
+			sealedChkpt.size(),
+			&chainId,
+			outStartBlkNum
 		);
+		// the enclave keeps raw pointers to the services
+		m_hostBlockServices.push_back(hostBlockService);
+		m_spillStores.push_back(spillStore);
+
+		return chainId;
 	}
 
 
-	virtual void RecvBlock(const std::vector<uint8_t>& blockRlp) override
+	void RecvBlock(uint64_t chainId, const std::vector<uint8_t>& blockRlp)
 	{
 		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
 			ecall_decent_ethereum_recv_block,
 			m_encId,
+			chainId,
 			blockRlp.data(),
 			blockRlp.size()
 		);
 	}
 
 
+	/**
+	 * @brief Get a sealed checkpoint of the state of the given chain
+	 *
+	 */
+	std::vector<uint8_t> SealCheckpoint(uint64_t chainId)
+	{
+		std::vector<uint8_t> sealedChkpt;
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_seal_checkpoint,
+			m_encId,
+			chainId,
+			&sealedChkpt
+		);
+		return sealedChkpt;
+	}
+
+
+	void RunWorker()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_worker_run,
+			m_encId
+		);
+	}
+
+
+	void StopWorkers()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_worker_stop,
+			m_encId
+		);
+	}
+
+
+	void RunOutboundWorker()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_outbound_worker_run,
+			m_encId
+		);
+	}
+
+
+	void StopOutboundWorkers()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_outbound_worker_stop,
+			m_encId
+		);
+	}
+
+
+	void RunSpareOutboundWorker()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_outbound_spare_worker_run,
+			m_encId
+		);
+	}
+
+
+	/**
+	 * @brief Set the config of the outbound queues of subscribers; it
+	 *        should be called before subscribers can connect
+	 *
+	 * @param queueCapacity     Max number of messages queued per subscriber
+	 * @param overflowPolicy    "DropHeartbeat" or "Disconnect"
+	 * @param maxFullHeartbeats Max number of heartbeats in a row dropped
+	 *                          before the subscriber is disconnected;
+	 *                          0 means unlimited
+	 * @param sendTimeoutSec    Max number of seconds a send may take before
+	 *                          the subscriber is disconnected;
+	 *                          0 means unlimited
+	 */
+	void SetOutboundConfig(
+		uint64_t queueCapacity,
+		const std::string& overflowPolicy,
+		uint64_t maxFullHeartbeats,
+		uint64_t sendTimeoutSec
+	)
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_set_outbound_config,
+			m_encId,
+			queueCapacity,
+			overflowPolicy.c_str(),
+			maxFullHeartbeats,
+			sendTimeoutSec
+		);
+	}
+
+
+	/**
+	 * @brief Push the events that came in since the last tick to the
+	 *        subscribers
+	 *
+	 */
+	void PushTick()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_push_tick,
+			m_encId
+		);
+	}
+
+
 private:
-	std::shared_ptr<HostBlockService> m_hostBlockService;
+	std::vector<std::shared_ptr<HostBlockService> > m_hostBlockServices;
+	std::vector<std::shared_ptr<SpillStore> > m_spillStores;
 }; // class DecentEthereumEnclave
 
 
+/**
+ * @brief Receives the blocks of one chain and passes them to the enclave
+ *
+ */
+class ChainBlockReceiver :
+	public BlockReceiver
+{
+public:
+
+	ChainBlockReceiver(
+		std::shared_ptr<DecentEthereumEnclave> enclave,
+		uint64_t chainId
+	) :
+		BlockReceiver(),
+		m_enclave(enclave),
+		m_chainId(chainId)
+	{}
+
+	virtual ~ChainBlockReceiver() = default;
+
+	virtual void RecvBlock(const std::vector<uint8_t>& blockRlp) override
+	{
+		m_enclave->RecvBlock(m_chainId, blockRlp);
+	}
+
+private:
+	std::shared_ptr<DecentEthereumEnclave> m_enclave;
+	uint64_t m_chainId;
+}; // class ChainBlockReceiver
+
+
 } // namespace Untrusted
 } // namespace DecentEthereum
 
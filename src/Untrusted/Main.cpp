@@ -17,7 +17,11 @@
 #include <DecentEnclave/Untrusted/Hosting/HeartbeatEmitterService.hpp>
 #include <DecentEnclave/Untrusted/Hosting/LambdaFuncServer.hpp>
 
+#include <DecentEthereum/Untrusted/CheckpointStore.hpp>
+#include <DecentEthereum/Untrusted/EnclaveWorkerThreads.hpp>
 #include <DecentEthereum/Untrusted/HostBlockServiceTasks.hpp>
+#include <DecentEthereum/Untrusted/PushTickTask.hpp>
+#include <DecentEthereum/Untrusted/SpillStore.hpp>
 
 #include <SimpleConcurrency/Threading/ThreadPool.hpp>
 #include <SimpleJson/SimpleJson.hpp>
@@ -41,16 +45,122 @@ using namespace SimpleObjects;
 using namespace SimpleSysIO::SysCall;
 
 
-std::shared_ptr<ThreadPool> GetThreadPool()
+/**
+ * @brief Threads used by the heartbeat emitter, the push ticks,
+ *        the IO service, and the API call server
+ *
+ */
+static constexpr size_t sk_numBaseThreads = 4;
+
+
+/**
+ * @brief Threads used by each chain, i.e., the block updator,
+ *        the block status logger, and the checkpoint task
+ *
+ */
+static constexpr size_t sk_numThreadsPerChain = 3;
+
+
+struct ChainSetup
+{
+	std::string                       m_name;
+	std::string                       m_netName;
+	std::shared_ptr<HostBlockService> m_hostBlkSvc;
+	EclipseMonitor::Eth::ContractAddr m_syncAddr;
+	EclipseMonitor::Eth::ContractAddr m_pubsubAddr;
+	uint64_t                          m_retainMaxEvents;
+	uint64_t                          m_retainMaxBytes;
+	uint64_t                          m_retainMaxBlkAge;
+	std::shared_ptr<SpillStore>       m_spillStore;
+	uint64_t                          m_spillHotChunks;
+	uint64_t                          m_spillMaxColdChunks;
+	uint64_t                          m_startBlockNum;
+	std::shared_ptr<CheckpointStore>  m_chkptStore;
+	int64_t                           m_chkptIntervalMliSec;
+	uint64_t                          m_chainId;
+	std::shared_ptr<BlockReceiver>    m_blkReceiver;
+}; // struct ChainSetup
+
+
+static EclipseMonitor::Eth::ContractAddr ParseContractAddr(
+	const std::string& addrHex,
+	const std::string& addrName
+)
+{
+	auto addrBytes = Codec::Hex::Decode<std::vector<uint8_t> >(addrHex);
+	EclipseMonitor::Eth::ContractAddr addr;
+	if (addrBytes.size() != addr.size())
+	{
+		throw std::runtime_error("Invalid " + addrName + " contract address.");
+	}
+	std::copy(addrBytes.begin(), addrBytes.end(), addr.begin());
+	return addr;
+}
+
+
+static ChainSetup ParseChainConfig(const DictBaseObj& chainConfig)
 {
-	static  std::shared_ptr<ThreadPool> threadPool =
-		std::make_shared<ThreadPool>(5);
+	ChainSetup chain;
+	chain.m_name = chainConfig[String("Name")].AsString().c_str();
+	chain.m_netName = chainConfig[String("Network")].AsString().c_str();
 
-	return threadPool;
+	// Geth configs
+	const auto& gethConfig = chainConfig[String("Geth")].AsDict();
+	std::string gethProto = gethConfig[String("Protocol")].AsString().c_str();
+	std::string gethHost = gethConfig[String("Host")].AsString().c_str();
+	uint32_t gethPort = gethConfig[String("Port")].AsCppUInt32();
+	chain.m_syncAddr = ParseContractAddr(
+		gethConfig[String("SyncAddr")].AsString().c_str(),
+		"Sync"
+	);
+
+	// Host block service
+	std::string gethUrl =
+		gethProto + "://" + gethHost + ":" + std::to_string(gethPort);
+	chain.m_hostBlkSvc = HostBlockService::Create(gethUrl);
+
+	// Pubsub configs
+	const auto& pubsubConfig = chainConfig[String("PubSub")].AsDict();
+	chain.m_startBlockNum = pubsubConfig[String("StartBlock")].AsCppUInt64();
+	chain.m_pubsubAddr = ParseContractAddr(
+		pubsubConfig[String("PubSubAddr")].AsString().c_str(),
+		"Pub-Sub"
+	);
+	const auto& retentionConfig = pubsubConfig[String("Retention")].AsDict();
+	chain.m_retainMaxEvents =
+		retentionConfig[String("MaxEvents")].AsCppUInt64();
+	chain.m_retainMaxBytes =
+		retentionConfig[String("MaxBytes")].AsCppUInt64();
+	chain.m_retainMaxBlkAge =
+		retentionConfig[String("MaxBlockAge")].AsCppUInt64();
+	const auto& spillConfig = pubsubConfig[String("Spill")].AsDict();
+	chain.m_spillHotChunks = spillConfig[String("HotChunks")].AsCppUInt64();
+	chain.m_spillMaxColdChunks =
+		spillConfig[String("MaxColdChunks")].AsCppUInt64();
+	if (chain.m_spillHotChunks != 0)
+	{
+		// 0 hot chunks disables spilling
+		chain.m_spillStore = std::make_shared<SpillStore>(
+			spillConfig[String("PathPrefix")].AsString().c_str()
+		);
+	}
+
+	// Checkpoint
+	const auto& chkptConfig = chainConfig[String("Checkpoint")].AsDict();
+	chain.m_chkptStore = std::make_shared<CheckpointStore>(
+		chkptConfig[String("Path")].AsString().c_str()
+	);
+	chain.m_chkptIntervalMliSec =
+		chkptConfig[String("IntervalSec")].AsCppUInt64() * 1000;
+
+	chain.m_chainId = 0;
+
+	return chain;
 }
 
 
 static void StartSendingBlocks(
+	std::shared_ptr<ThreadPool> threadPool,
 	HostBlockService& blkSvc,
 	uint64_t startBlockNum
 )
@@ -70,8 +180,6 @@ static void StartSendingBlocks(
 		new BlockUpdatorServiceTask(blkSvcSPtr, 1 * 1000)
 	);
 
-	std::shared_ptr<ThreadPool> threadPool = GetThreadPool();
-
 	threadPool->AddTask(std::move(blkUpdStatusSvc));
 	threadPool->AddTask(std::move(blkUpdSvc));
 }
@@ -101,10 +209,6 @@ int main(int argc, char* argv[])
 	Common::Sgx::MbedTlsInit::Init();
 
 
-	// Thread pool
-	std::shared_ptr<ThreadPool> threadPool = GetThreadPool();
-
-
 	// Read in components config
 	auto configFile = RBinaryFile::Open(configPath);
 	auto configJson = configFile->ReadBytes<std::string>();
@@ -112,6 +216,24 @@ int main(int argc, char* argv[])
 	std::vector<uint8_t> authListAdvRlp = Config::ConfigToAuthListAdvRlp(config);
 
 
+	// Chain configs
+	std::vector<ChainSetup> chains;
+	for (const auto& chainConfig : config.AsDict()[String("Chains")].AsList())
+	{
+		chains.push_back(ParseChainConfig(chainConfig.AsDict()));
+	}
+	if (chains.empty())
+	{
+		throw std::runtime_error("No chain is configured.");
+	}
+
+
+	// Thread pool
+	std::shared_ptr<ThreadPool> threadPool = std::make_shared<ThreadPool>(
+		sk_numBaseThreads + (chains.size() * sk_numThreadsPerChain)
+	);
+
+
 	// Boost IO Service
 	std::unique_ptr<Hosting::BoostAsioService> asioService =
 		SimpleObjects::Internal::make_unique<Hosting::BoostAsioService>();
@@ -124,58 +246,93 @@ int main(int argc, char* argv[])
 	);
 
 
-	// Geth configs
-	const auto& gethConfig = config.AsDict()[String("Geth")].AsDict();
-	std::string gethProto = gethConfig[String("Protocol")].AsString().c_str();
-	std::string gethHost = gethConfig[String("Host")].AsString().c_str();
-	uint32_t gethPort = gethConfig[String("Port")].AsCppUInt32();
-	std::string syncAddrHex = gethConfig[String("SyncAddr")].AsString().c_str();
-	auto syncAddrBytes = Codec::Hex::Decode<std::vector<uint8_t> >(syncAddrHex);
-	EclipseMonitor::Eth::ContractAddr syncAddr;
-	if (syncAddrBytes.size() != syncAddr.size())
-	{
-		throw std::runtime_error("Invalid Sync contract address.");
-	}
-
-
-	// Host block service
-	std::string gethUrl =
-		gethProto + "://" + gethHost + ":" + std::to_string(gethPort);
-	std::shared_ptr<HostBlockService> hostBlkSvc =
-		HostBlockService::Create(gethUrl);
-
-
-	// Pubsub configs
-	const auto& pubsubConfig = config.AsDict()[String("PubSub")].AsDict();
-	std::string pubsubAddrHex = pubsubConfig[String("PubSubAddr")].AsString().c_str();
-	uint64_t startBlockNum = pubsubConfig[String("StartBlock")].AsCppUInt64();
-	auto pubsubAddrBytes = Codec::Hex::Decode<std::vector<uint8_t> >(pubsubAddrHex);
-	EclipseMonitor::Eth::ContractAddr pubsubAddr;
-	if (pubsubAddrBytes.size() != pubsubAddr.size())
-	{
-		throw std::runtime_error("Invalid Pub-Sub contract address.");
-	}
-	std::copy(pubsubAddrBytes.begin(), pubsubAddrBytes.end(), pubsubAddr.begin());
-
-
 	// Enclave
 	const auto& imgConfig = config.AsDict()[String("EnclaveImage")].AsDict();
 	std::string imgPath = imgConfig[String("ImagePath")].AsString().c_str();
 	std::string tokenPath = imgConfig[String("TokenPath")].AsString().c_str();
 	std::shared_ptr<DecentEthereumEnclave> enclave =
 		std::make_shared<DecentEthereumEnclave>(
-			EclipseMonitor::BuildEthereumMonitorConfig(),
-			startBlockNum,
-			syncAddr,
-			"SyncMsg(bytes16,bytes32)",
-			pubsubAddr,
-			hostBlkSvc,
 			authListAdvRlp,
 			imgPath,
 			tokenPath
 		);
-	hostBlkSvc->BindReceiver(enclave);
-	StartSendingBlocks(*hostBlkSvc, startBlockNum);
+	for (auto& chain : chains)
+	{
+		// the enclave may resume from the checkpoint, so the start block
+		// is decided by the enclave
+		chain.m_chainId = enclave->AddChain(
+			chain.m_name,
+			chain.m_netName,
+			EclipseMonitor::BuildEthereumMonitorConfig(),
+			chain.m_startBlockNum,
+			chain.m_syncAddr,
+			"SyncMsg(bytes16,bytes32)",
+			chain.m_pubsubAddr,
+			chain.m_retainMaxEvents,
+			chain.m_retainMaxBytes,
+			chain.m_retainMaxBlkAge,
+			chain.m_spillStore,
+			chain.m_spillHotChunks,
+			chain.m_spillMaxColdChunks,
+			chain.m_hostBlkSvc,
+			chain.m_chkptStore->Load(),
+			&chain.m_startBlockNum
+		);
+		chain.m_blkReceiver =
+			std::make_shared<ChainBlockReceiver>(enclave, chain.m_chainId);
+		chain.m_hostBlkSvc->BindReceiver(chain.m_blkReceiver);
+	}
+
+
+	// Enclave workers (used to verify receipts in parallel)
+	uint64_t numWorkers = config.AsDict()[String("EnclaveWorkers")].AsCppUInt64();
+	EnclaveWorkerThreads enclaveWorkers(enclave, numWorkers);
+	// Outbound workers (used to send messages to subscribers)
+	uint64_t numOutWorkers =
+		config.AsDict()[String("OutboundWorkers")].AsCppUInt64();
+	EnclaveWorkerThreads outboundWorkers(
+		[enclave]() { enclave->RunOutboundWorker(); },
+		[enclave]() { enclave->StopOutboundWorkers(); },
+		numOutWorkers
+	);
+	// Outbound queues of subscribers, and the spare outbound workers taking
+	// over the ones stuck in sends to stalled subscribers
+	const auto& outboundConfig = config.AsDict()[String("Outbound")].AsDict();
+	enclave->SetOutboundConfig(
+		outboundConfig[String("QueueCapacity")].AsCppUInt64(),
+		outboundConfig[String("OverflowPolicy")].AsString().c_str(),
+		outboundConfig[String("MaxFullHeartbeats")].AsCppUInt64(),
+		outboundConfig[String("SendTimeoutSec")].AsCppUInt64()
+	);
+	EnclaveWorkerThreads spareOutboundWorkers(
+		[enclave]() { enclave->RunSpareOutboundWorker(); },
+		[enclave]() { enclave->StopOutboundWorkers(); },
+		outboundConfig[String("SpareWorkers")].AsCppUInt64()
+	);
+
+
+	// Each chain has its own block ingestion and checkpoint tasks
+	for (const auto& chain : chains)
+	{
+		StartSendingBlocks(
+			threadPool,
+			*chain.m_hostBlkSvc,
+			chain.m_startBlockNum
+		);
+
+		const uint64_t chainId = chain.m_chainId;
+		std::shared_ptr<CheckpointStore> chkptStore = chain.m_chkptStore;
+		auto chkptTask = std::unique_ptr<CheckpointTask>(
+			new CheckpointTask(
+				[enclave, chainId, chkptStore]()
+				{
+					chkptStore->Save(enclave->SealCheckpoint(chainId));
+				},
+				chain.m_chkptIntervalMliSec
+			)
+		);
+		threadPool->AddTask(std::move(chkptTask));
+	}
 
 
 	// API call server
@@ -194,6 +351,27 @@ int main(int argc, char* argv[])
 	threadPool->AddTask(std::move(heartbeatEmitter));
 
 
+	// Push mode; the heartbeat above is then only a liveness signal;
+	// the enclave arms the push alarm when events come in, and the task
+	// ticks once, one window later
+	int64_t pushWindowMliSec = static_cast<int64_t>(
+		config.AsDict()[String("PushWindowMliSec")].AsCppUInt64()
+	);
+	if (pushWindowMliSec > 0)
+	{
+		auto pushTickTask = std::unique_ptr<PushTickTask>(
+			new PushTickTask(
+				[enclave]()
+				{
+					enclave->PushTick();
+				},
+				pushWindowMliSec
+			)
+		);
+		threadPool->AddTask(std::move(pushTickTask));
+	}
+
+
 	// Start IO service
 	threadPool->AddTask(std::move(asioService));
 
@@ -209,6 +387,25 @@ int main(int argc, char* argv[])
 
 	threadPool->Terminate();
 
+	for (const auto& chain : chains)
+	{
+		try
+		{
+			chain.m_chkptStore->Save(enclave->SealCheckpoint(chain.m_chainId));
+		}
+		catch (const std::exception& e)
+		{
+			Common::Platform::Print::StrErr(
+				"Failed to save checkpoint of chain " + chain.m_name + ": " +
+				e.what()
+			);
+		}
+	}
+
+	spareOutboundWorkers.Stop();
+	outboundWorkers.Stop();
+	enclaveWorkers.Stop();
+
 
 	return 0;
 }
@@ -303,3 +500,118 @@ extern "C" sgx_status_t ocall_decent_ethereum_send_raw_transaction(
 	}
 }
 
+
+extern "C" sgx_status_t ocall_decent_ethereum_store_checkpoint(
+	void* host_chkpt_store,
+	const uint8_t* in_chkpt,
+	size_t in_chkpt_size
+)
+{
+	std::vector<uint8_t>* sealedChkpt =
+		static_cast<std::vector<uint8_t>*>(host_chkpt_store);
+
+	try
+	{
+		sealedChkpt->assign(in_chkpt, in_chkpt + in_chkpt_size);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_store_checkpoint failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_store(
+	void* host_spill_store,
+	uint64_t key,
+	const uint8_t* in_data,
+	size_t in_data_size
+)
+{
+	SpillStore* spillStore = static_cast<SpillStore*>(host_spill_store);
+
+	try
+	{
+		spillStore->Save(key, in_data, in_data_size);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_spill_store failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_load(
+	void* host_spill_store,
+	uint64_t key,
+	uint8_t** out_buf,
+	size_t* out_buf_size
+)
+{
+	const SpillStore* spillStore =
+		static_cast<const SpillStore*>(host_spill_store);
+
+	try
+	{
+		std::vector<uint8_t> bytes = spillStore->Load(key);
+
+		*out_buf = new uint8_t[bytes.size()];
+		*out_buf_size = bytes.size();
+
+		std::copy(bytes.begin(), bytes.end(), *out_buf);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_spill_load failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_remove(
+	void* host_spill_store,
+	uint64_t key
+)
+{
+	SpillStore* spillStore = static_cast<SpillStore*>(host_spill_store);
+
+	try
+	{
+		spillStore->Remove(key);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_spill_remove failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_schedule_push()
+{
+	PushAlarm::GetInstance().Arm();
+
+	return SGX_SUCCESS;
+}
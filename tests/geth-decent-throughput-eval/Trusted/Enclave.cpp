@@ -5,9 +5,14 @@
 
 
 #include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <sgx_edger8r.h>
 
+#include <AdvancedRlp/AdvancedRlp.hpp>
+
 #include <EclipseMonitor/Eth/DAA.hpp>
 #include <EclipseMonitor/Eth/HeaderMgr.hpp>
 #include <EclipseMonitor/Eth/ReceiptsMgr.hpp>
@@ -18,7 +23,12 @@
 #include <DecentEnclave/Trusted/PlatformId.hpp>
 #include <DecentEnclave/Trusted/Sgx/EnclaveIdentity.hpp>
 
+#include <DecentEthereum/Trusted/EnclaveWorkerPool.hpp>
 #include <DecentEthereum/Trusted/HostBlockService.hpp>
+#include <DecentEthereum/Trusted/Pubsub/SubscriberService.hpp>
+#include <DecentEthereum/Trusted/ReceiptJobQueue.hpp>
+#include <DecentEthereum/Trusted/SealedCheckpoint.hpp>
+#include <DecentEthereum/Trusted/SealedSpillStore.hpp>
 
 
 using EthChainConfig = EclipseMonitor::Eth::GoerliConfig;
@@ -30,6 +40,7 @@ namespace DecentEthereum
 static uint8_t g_receiptLimit = 0;
 static size_t g_verifiedReceipts = 0;
 static std::unique_ptr<Trusted::HostBlockService> g_hostBlkSvc;
+static std::unique_ptr<Trusted::ReceiptJobQueue> g_receiptJobs;
 static DecentEnclave::Common::Logger g_logger =
 	DecentEnclave::Common::LoggerFactory::GetLogger("Enclave");
 
@@ -68,10 +79,45 @@ void Init(
 	PrintMyInfo();
 
 	g_hostBlkSvc = std::move(blkSvc);
+	g_receiptJobs = SimpleObjects::Internal::make_unique<Trusted::ReceiptJobQueue>(
+		[](EclipseMonitor::Eth::BlockNumber blkNum) -> SimpleObjects::Object
+		{
+			return g_hostBlkSvc->GetReceiptsRlpByNum(blkNum);
+		},
+		false
+	);
+}
+
+
+void CommitReceiptJobs(size_t maxPending)
+{
+	g_receiptJobs->Commit(
+		[](const Trusted::ReceiptJobQueue::Job&)
+		{
+			// there is no listener to be added later in this evaluation
+			return false;
+		},
+		[](Trusted::ReceiptJobQueue::Job& job)
+		{
+			if (job.m_hasReceipts)
+			{
+				++g_verifiedReceipts;
+			}
+		},
+		maxPending
+	);
+}
+
+
+void Flush()
+{
+	CommitReceiptJobs(0);
 }
 
 void SetReceiptRate(double receiptRate)
 {
+	Flush();
+
 	g_receiptLimit = std::numeric_limits<uint8_t>::max() * receiptRate;
 	// (e.g., 255 * 0% = 0 -> 0)
 	// (e.g., 255 * 10% = 25.5 -> 25)
@@ -86,28 +132,224 @@ void SetReceiptRate(double receiptRate)
 
 void RecvBlock(const std::vector<uint8_t>& hdrRlp)
 {
-	EclipseMonitor::Eth::HeaderMgr headerMgr(hdrRlp, 0);
+	auto headerMgr =
+		std::make_shared<const EclipseMonitor::Eth::HeaderMgr>(hdrRlp, 0);
 
-	const auto& hdrHash = headerMgr.GetHash();
+	const auto& hdrHash = headerMgr->GetHash();
 	const auto& lastHashByte = hdrHash[hdrHash.size() - 1];
 
 	if (lastHashByte < g_receiptLimit || g_receiptLimit == 255)
 	{
-		// verify receipt
-		EclipseMonitor::Eth::ReceiptsMgr receiptsMgr(
-			g_hostBlkSvc->GetReceiptsRlpByNum(
-				headerMgr.GetNumber()
-			).AsList()
+		// verify receipt (on the worker pool, if there is any)
+		g_receiptJobs->Submit(headerMgr, true);
+	}
+
+	CommitReceiptJobs(
+		Trusted::EnclaveWorkerPool::GetInstance().GetNumWorkers() * 2
+	);
+}
+
+
+static const char* sk_chkptTestChainName = "GethThroughputEval";
+static constexpr uint8_t sk_chkptTestNumPubs = 3;
+// several chunks per log, so most of them are spilled to the host
+static constexpr uint64_t sk_chkptTestNumEvents = 300;
+
+
+/**
+ * @brief The address of the test publisher (or its event manager), which
+ *        is the given byte repeated
+ *
+ */
+SimpleObjects::Bytes TestContractAddr(uint8_t fill)
+{
+	EclipseMonitor::Eth::ContractAddr addr;
+	addr.fill(fill);
+	return SimpleObjects::Bytes(addr.begin(), addr.end());
+}
+
+
+/**
+ * @brief Build the checkpoint of a pub-sub service with a few publishers
+ *        registered, each with some past events;
+ *        it's the same in every run, so the enclave restarted from the
+ *        sealed checkpoint can tell what the restored state should be
+ *
+ */
+SimpleObjects::Dict BuildTestPubsubCheckpoint()
+{
+	using namespace Trusted::Pubsub;
+
+	SimpleObjects::List regs;
+	SimpleObjects::List pastEvents;
+	for (uint8_t i = 0; i < sk_chkptTestNumPubs; ++i)
+	{
+		const SimpleObjects::Bytes pubAddr = TestContractAddr(0x10 + i);
+		const SimpleObjects::Bytes evMgrAddr = TestContractAddr(0x20 + i);
+		regs.push_back(
+			SimpleObjects::ListT<SimpleObjects::Bytes>({ pubAddr, evMgrAddr })
 		);
+
+		EventDataQueue events;
+		for (uint64_t j = 0; j < sk_chkptTestNumEvents; ++j)
+		{
+			const std::string evMsg =
+				"Event " + std::to_string(j) + " of publisher " +
+				std::to_string(i);
+			events.push_back(EventData({
+				BlkNumToBytes(8875000 + j),
+				SimpleObjects::Bytes(evMsg.begin(), evMsg.end()),
+			}));
+		}
+
+		// [evMgrId, hot events, first seq, spill keys, spill offset]
+		SimpleObjects::List storeEntry;
+		storeEntry.push_back(evMgrAddr);
+		storeEntry.push_back(std::move(events));
+		storeEntry.push_back(BlkNumToBytes(i * 1000));
+		storeEntry.push_back(SimpleObjects::List());
+		storeEntry.push_back(BlkNumToBytes(0));
+		pastEvents.push_back(std::move(storeEntry));
+	}
+
+	SimpleObjects::Dict chkpt;
+	chkpt[SimpleObjects::String("IsDeployed")] = SimpleObjects::Bytes({ 1 });
+	chkpt[SimpleObjects::String("Registrations")] = std::move(regs);
+	chkpt[SimpleObjects::String("PastEvents")] = std::move(pastEvents);
+	chkpt[SimpleObjects::String("SpillLabel")] = SimpleObjects::Bytes();
+	return chkpt;
+}
+
+
+/**
+ * @param hostSpillStore The host store to spill past events to;
+ *                       nullptr keeps all of them in the enclave
+ */
+std::unique_ptr<Trusted::Pubsub::SubscriberService> NewTestPubsubService(
+	void* hostSpillStore
+)
+{
+	using namespace Trusted::Pubsub;
+
+	EventSpill spill;
+	if (hostSpillStore != nullptr)
+	{
+		spill = EventSpill(
+			std::make_shared<Trusted::SealedSpillStore>(
+				hostSpillStore,
+				sk_chkptTestChainName
+			),
+			1,
+			0
+		);
+	}
+
+	return SimpleObjects::Internal::make_unique<SubscriberService>(
+		EclipseMonitor::Eth::ContractAddr(),
+		"ServiceDeployed(address)",
+		"PublisherRegistered(address,address)",
+		"NotifySubscribers(bytes)",
+		EventRetention(),
+		spill
+	);
+}
+
+
+/**
+ * @brief Seal the checkpoint of the test pub-sub service, and pass it to
+ *        the host; the past events it spills are kept by the host as well
+ *
+ */
+void SealTestCheckpoint(void* hostSpillStore, void* hostChkptStore)
+{
+	auto subSvc = NewTestPubsubService(hostSpillStore);
+	subSvc->RestoreCheckpoint(BuildTestPubsubCheckpoint());
+
+	const auto stats = subSvc->GetPastEventStats();
+	g_logger.Info(
+		"Sealing a checkpoint with " +
+		std::to_string(stats.m_numRetainedEvents) + " past events, " +
+		std::to_string(stats.m_numSpilledChunks) + " chunks spilled"
+	);
+
+	Trusted::StoreCheckpoint(
+		hostChkptStore,
+		Trusted::SealCheckpoint(
+			AdvancedRlp::GenericWriter::Write(subSvc->BuildCheckpoint()),
+			sk_chkptTestChainName
+		)
+	);
+}
+
+
+/**
+ * @brief Restore a pub-sub service from the checkpoint sealed by
+ *        SealTestCheckpoint, most likely by an earlier instance of the
+ *        enclave, and check its state against the one it was built from
+ *
+ * @exception std::runtime_error if the restored state is different
+ */
+void CheckTestCheckpoint(
+	void* hostSpillStore,
+	const std::vector<uint8_t>& sealedChkpt
+)
+{
+	auto chkpt = AdvancedRlp::Parse(
+		Trusted::UnsealCheckpoint(sealedChkpt, sk_chkptTestChainName)
+	);
+	auto restored = NewTestPubsubService(hostSpillStore);
+	restored->RestoreCheckpoint(chkpt.AsDict());
+
+	auto expected = NewTestPubsubService(nullptr);
+	expected->RestoreCheckpoint(BuildTestPubsubCheckpoint());
+
+	for (uint8_t i = 0; i < sk_chkptTestNumPubs; ++i)
+	{
+		const std::string pubName = "publisher " + std::to_string(i);
+		const auto pubAddr = TestContractAddr(0x10 + i);
+
+		const auto evMgrAddr = restored->GetEventMgrAddr(pubAddr);
+		if (evMgrAddr != expected->GetEventMgrAddr(pubAddr))
+		{
+			throw std::runtime_error(
+				"The registration of " + pubName + " is not restored"
+			);
+		}
+
+		auto restoredLog = restored->GetPastEventLog(evMgrAddr);
+		auto expectedLog = expected->GetPastEventLog(evMgrAddr);
+		if (restoredLog == nullptr)
+		{
+			throw std::runtime_error(
+				"The past events of " + pubName + " are not restored"
+			);
+		}
+
+		// the spilled events are paged in from the host
+		const auto restoredEvents = restoredLog->GetSnapshot();
+		const auto expectedEvents = expectedLog->GetSnapshot();
 		if (
-			receiptsMgr.GetRootHashBytes() !=
-			headerMgr.GetRawHeader().get_ReceiptsRoot()
+			(restoredEvents.GetBeginSeq() != expectedEvents.GetBeginSeq()) ||
+			(restoredEvents.GetEndSeq() != expectedEvents.GetEndSeq()) ||
+			(
+				restoredEvents.ToEventDataQueue() !=
+					expectedEvents.ToEventDataQueue()
+			)
 		)
 		{
-			throw std::runtime_error("Receipts root mismatch");
+			throw std::runtime_error(
+				"The past events of " + pubName + " are not restored as "
+				"they were"
+			);
 		}
-		++g_verifiedReceipts;
 	}
+
+	const auto stats = restored->GetPastEventStats();
+	g_logger.Info(
+		"Restored a checkpoint with " +
+		std::to_string(stats.m_numRetainedEvents) + " past events, " +
+		std::to_string(stats.m_numSpilledChunks) + " chunks spilled"
+	);
 }
 
 
@@ -159,6 +401,23 @@ extern "C" sgx_status_t ecall_decent_ethereum_set_receipt_rate(
 }
 
 
+extern "C" sgx_status_t ecall_decent_ethereum_flush()
+{
+	try
+	{
+		DecentEthereum::Flush();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
 extern "C" sgx_status_t ecall_decent_ethereum_recv_block(
 	const uint8_t* hdr_rlp,
 	size_t hdr_size
@@ -178,3 +437,79 @@ extern "C" sgx_status_t ecall_decent_ethereum_recv_block(
 		return SGX_ERROR_UNEXPECTED;
 	}
 }
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_worker_run()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetInstance().RunWorker();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_worker_stop()
+{
+	try
+	{
+		DecentEthereum::Trusted::EnclaveWorkerPool::GetInstance().Terminate();
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_seal_test_checkpoint(
+	void* host_spill_store,
+	void* host_chkpt_store
+)
+{
+	try
+	{
+		DecentEthereum::SealTestCheckpoint(host_spill_store, host_chkpt_store);
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ecall_decent_ethereum_check_test_checkpoint(
+	void* host_spill_store,
+	const uint8_t* in_chkpt,
+	size_t in_chkpt_size
+)
+{
+	try
+	{
+		std::vector<uint8_t> sealedChkpt(in_chkpt, in_chkpt + in_chkpt_size);
+		DecentEthereum::CheckTestCheckpoint(host_spill_store, sealedChkpt);
+
+		return SGX_SUCCESS;
+	}
+	catch(const std::exception& e)
+	{
+		using namespace DecentEnclave::Common;
+		Platform::Print::StrErr(e.what());
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
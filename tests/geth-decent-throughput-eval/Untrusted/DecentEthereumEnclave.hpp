@@ -11,6 +11,7 @@
 
 #include <DecentEthereum/Untrusted/BlockReceiver.hpp>
 #include <DecentEthereum/Untrusted/HostBlockService.hpp>
+#include <DecentEthereum/Untrusted/SpillStore.hpp>
 
 
 extern "C" sgx_status_t ecall_decent_ethereum_init(
@@ -29,6 +30,31 @@ extern "C" sgx_status_t ecall_decent_ethereum_recv_block(
 	const uint8_t*   blk_data,
 	size_t           blk_size
 );
+extern "C" sgx_status_t ecall_decent_ethereum_flush(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_worker_run(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_worker_stop(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval
+);
+extern "C" sgx_status_t ecall_decent_ethereum_seal_test_checkpoint(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval,
+	void*            host_spill_store,
+	void*            host_chkpt_store
+);
+extern "C" sgx_status_t ecall_decent_ethereum_check_test_checkpoint(
+	sgx_enclave_id_t eid,
+	sgx_status_t*    retval,
+	void*            host_spill_store,
+	const uint8_t*   in_chkpt,
+	size_t           in_chkpt_size
+);
 
 
 namespace DecentEthereum
@@ -83,6 +109,75 @@ public:
 	}
 
 
+	void Flush()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_flush,
+			m_encId
+		);
+	}
+
+
+	void RunWorker()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_worker_run,
+			m_encId
+		);
+	}
+
+
+	void StopWorkers()
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_worker_stop,
+			m_encId
+		);
+	}
+
+
+	/**
+	 * @brief Seal the checkpoint of a test pub-sub service, whose past
+	 *        events are partly spilled to the given store
+	 *
+	 * @return The sealed checkpoint
+	 */
+	std::vector<uint8_t> SealTestCheckpoint(
+		Untrusted::SpillStore& spillStore
+	)
+	{
+		std::vector<uint8_t> sealedChkpt;
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_seal_test_checkpoint,
+			m_encId,
+			&spillStore,
+			&sealedChkpt
+		);
+		return sealedChkpt;
+	}
+
+
+	/**
+	 * @brief Restore the test pub-sub service from the checkpoint sealed by
+	 *        SealTestCheckpoint, and check its state; the ECall fails if
+	 *        the state isn't restored as it was
+	 *
+	 */
+	void CheckTestCheckpoint(
+		Untrusted::SpillStore& spillStore,
+		const std::vector<uint8_t>& sealedChkpt
+	)
+	{
+		DECENTENCLAVE_SGX_ECALL_CHECK_ERROR_E_R(
+			ecall_decent_ethereum_check_test_checkpoint,
+			m_encId,
+			&spillStore,
+			sealedChkpt.data(),
+			sealedChkpt.size()
+		);
+	}
+
+
 private:
 	std::shared_ptr<HostBlockService> m_hostBlockService;
 }; // class DecentEthereumEnclave
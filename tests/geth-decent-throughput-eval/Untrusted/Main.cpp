@@ -14,6 +14,7 @@
 #include <DecentEnclave/Common/Sgx/MbedTlsInit.hpp>
 #include <DecentEnclave/Untrusted/Config/AuthList.hpp>
 
+#include <DecentEthereum/Untrusted/EnclaveWorkerThreads.hpp>
 #include <DecentEthereum/Untrusted/HostBlockService.hpp>
 
 #include <SimpleJson/SimpleJson.hpp>
@@ -28,6 +29,7 @@ using namespace DecentEnclave;
 using namespace DecentEnclave::Common;
 using namespace DecentEnclave::Untrusted;
 using namespace DecentEthereum;
+using namespace DecentEthereum::Untrusted;
 using namespace SimpleObjects;
 
 
@@ -37,22 +39,75 @@ static inline uint64_t TimeNow()
 }
 
 
+/**
+ * @brief Seal a checkpoint of a test pub-sub service, restart the enclave,
+ *        and let the new instance restore the pub-sub service from the
+ *        checkpoint and check its state
+ *
+ */
+static int RunCheckpointTest(
+	std::shared_ptr<HostBlockService> hostBlkSvc,
+	const std::string& imgPath,
+	const std::string& tokenPath
+)
+{
+	// the past events spilled are kept across the restart, since the
+	// checkpoint refers to them
+	SpillStore spillStore("GethThroughputEval_Spill_");
+
+	std::vector<uint8_t> sealedChkpt;
+	{
+		DecentEthereumEnclave enclave(hostBlkSvc, imgPath, tokenPath);
+		sealedChkpt = enclave.SealTestCheckpoint(spillStore);
+	}
+	std::cout
+		<< "Sealed checkpoint: " << sealedChkpt.size() << " bytes" << std::endl;
+
+	DecentEthereumEnclave enclave(hostBlkSvc, imgPath, tokenPath);
+	try
+	{
+		enclave.CheckTestCheckpoint(spillStore, sealedChkpt);
+	}
+	catch (const std::exception& e)
+	{
+		Common::Platform::Print::StrErr(
+			std::string("Checkpoint test failed: ") + e.what()
+		);
+		return -1;
+	}
+	std::cout << "Checkpoint test passed" << std::endl;
+
+	return 0;
+}
+
+
 int main(int argc, char* argv[])
 {
+	// --checkpoint-test: seal and resume from a checkpoint, instead of
+	// measuring the throughput
+	std::vector<std::string> args(argv + 1, argv + argc);
+	bool isChkptTest = false;
+	if (!args.empty() && (args[0] == "--checkpoint-test"))
+	{
+		isChkptTest = true;
+		args.erase(args.begin());
+	}
+
 	std::string configPath;
-	if (argc == 1)
+	if (args.size() == 0)
 	{
 		configPath = "../../../tests/geth-decent-throughput-eval/components_config.json";
 	}
-	else if (argc == 2)
+	else if (args.size() == 1)
 	{
-		configPath = argv[1];
+		configPath = args[0];
 	}
 	else
 	{
 		Common::Platform::Print::StrErr("Unexpected number of arguments.");
 		Common::Platform::Print::StrErr(
-			"Only the path to the components configuration file is needed."
+			"Only the path to the components configuration file is needed, "
+			"optionally preceded by --checkpoint-test."
 		);
 		return -1;
 	}
@@ -99,6 +154,10 @@ int main(int argc, char* argv[])
 	const auto& imgConfig = config.AsDict()[String("EnclaveImage")].AsDict();
 	std::string imgPath = imgConfig[String("ImagePath")].AsString().c_str();
 	std::string tokenPath = imgConfig[String("TokenPath")].AsString().c_str();
+	if (isChkptTest)
+	{
+		return RunCheckpointTest(hostBlkSvc, imgPath, tokenPath);
+	}
 	std::shared_ptr<DecentEthereumEnclave> enclave =
 		std::make_shared<DecentEthereumEnclave>(
 			hostBlkSvc,
@@ -108,6 +167,14 @@ int main(int argc, char* argv[])
 	hostBlkSvc->BindReceiver(enclave);
 
 
+	// Enclave workers (used to verify receipts in parallel)
+	uint64_t numWorkers = config.AsDict()[String("EnclaveWorkers")].AsCppUInt64();
+	DecentEthereum::Untrusted::EnclaveWorkerThreads enclaveWorkers(
+		enclave,
+		numWorkers
+	);
+
+
 	for (const double& receiptRate: receiptRates)
 	{
 		enclave->SetReceiptRate(receiptRate);
@@ -117,18 +184,21 @@ int main(int argc, char* argv[])
 		{
 			hostBlkSvc->PushBlock(i);
 		}
+		enclave->Flush();
 		auto end = TimeNow();
 		auto duration = end - start;
 		auto numBlocks = endBlockNum - startBlockNum;
 		auto rate = static_cast<double>(numBlocks) / duration;
 
 		std::cout
+			<< "Workers:    " << numWorkers << std::endl
 			<< "Receipt %:  " << receiptRate * 100 << "%" << std::endl
 			<< "Pushed:     " << numBlocks << " blocks" << std::endl
 			<< "Took:       " << duration  << " seconds" << std::endl
 			<< "Throughput: " << rate      << " blocks / second" << std::endl;
 	}
 	enclave->SetReceiptRate(0.00);
+	enclaveWorkers.Stop();
 
 
 	return 0;
@@ -170,3 +240,111 @@ extern "C" sgx_status_t ocall_decent_ethereum_get_receipts(
 		return SGX_ERROR_UNEXPECTED;
 	}
 }
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_store_checkpoint(
+	void* host_chkpt_store,
+	const uint8_t* in_chkpt,
+	size_t in_chkpt_size
+)
+{
+	std::vector<uint8_t>* sealedChkpt =
+		static_cast<std::vector<uint8_t>*>(host_chkpt_store);
+
+	try
+	{
+		sealedChkpt->assign(in_chkpt, in_chkpt + in_chkpt_size);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_store_checkpoint failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_store(
+	void* host_spill_store,
+	uint64_t key,
+	const uint8_t* in_data,
+	size_t in_data_size
+)
+{
+	SpillStore* spillStore = static_cast<SpillStore*>(host_spill_store);
+
+	try
+	{
+		spillStore->Save(key, in_data, in_data_size);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_spill_store failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_load(
+	void* host_spill_store,
+	uint64_t key,
+	uint8_t** out_buf,
+	size_t* out_buf_size
+)
+{
+	const SpillStore* spillStore =
+		static_cast<const SpillStore*>(host_spill_store);
+
+	try
+	{
+		std::vector<uint8_t> bytes = spillStore->Load(key);
+
+		*out_buf = new uint8_t[bytes.size()];
+		*out_buf_size = bytes.size();
+
+		std::copy(bytes.begin(), bytes.end(), *out_buf);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_spill_load failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}
+
+
+extern "C" sgx_status_t ocall_decent_ethereum_spill_remove(
+	void* host_spill_store,
+	uint64_t key
+)
+{
+	SpillStore* spillStore = static_cast<SpillStore*>(host_spill_store);
+
+	try
+	{
+		spillStore->Remove(key);
+
+		return SGX_SUCCESS;
+	}
+	catch (const std::exception& e)
+	{
+		DecentEnclave::Common::Platform::Print::StrDebug(
+			"ocall_decent_ethereum_spill_remove failed with error " +
+			std::string(e.what())
+		);
+		return SGX_ERROR_UNEXPECTED;
+	}
+}